@@ -26,7 +26,11 @@ typedef enum {
     PS_RET_ALREADY_JOIN_GROUP = 8,   // 该组已经加入
     PS_RET_UNLOGIN            = 9,   // 未登录
     PS_RET_CALL_TIMEOUT       = 10,  // 调用超时
-    PS_RET_CALL_FAILED        = 11   // 服务器返回失败
+    PS_RET_CALL_FAILED        = 11,  // 服务器返回失败
+    PS_RET_CALL_CANCELED      = 12,  // 调用被取消
+    PS_RET_CONFIG_INVALID     = 13,  // 配置项不存在、值无效(类型不匹配或越界)或配置文件无法解析
+    PS_RET_CONFIG_NOT_HOT     = 14,  // 该配置项只能在SDK初始化之前修改
+    PS_RET_IN_SDK_THREAD      = 15   // 不能在SDK回调(SDK内部线程)中调用
 } PushSDKRetCode;
 
 // Push SDK回调类型
@@ -45,7 +49,8 @@ typedef enum {
     PS_CB_EVENT_TIMEOUT            = 2,  // 调用超时
     PS_CB_EVENT_REQ_ENC_FAILED     = 3,  // 序列化请求包失败
     PS_CB_EVENT_RES_DEC_FAILED     = 4,  // 去序列化回复包失败
-    PS_CB_EVENT_USER_KICKED_BY_SRV = 5   // 登录后被踢下线
+    PS_CB_EVENT_USER_KICKED_BY_SRV = 5,  // 登录后被踢下线
+    PS_CB_EVENT_CANCELED           = 6   // 调用被取消
 
 } PushSDKCBEvent;
 
@@ -71,6 +76,49 @@ typedef struct
     uint64_t gid;
 } PushSDKGroupInfo;
 
+// 连接池中最多统计的连接数
+#define PS_MAX_CONN_STATS 16
+
+// 单个连接的统计，收发量为累计值，两次获取的差值除以间隔即为吞吐
+typedef struct
+{
+    uint64_t streams;     // 连接上的会话(stream)数
+    uint64_t msgs_sent;   // 累计发送消息数
+    uint64_t bytes_sent;  // 累计发送字节数
+    uint64_t msgs_recv;   // 累计接收消息数
+    uint64_t bytes_recv;  // 累计接收字节数
+} PushSDKConnStats;
+
+// SDK运行统计
+typedef struct
+{
+    uint64_t         relogin_retries;           // 累计重登重试次数
+    uint64_t         rejoin_retries;            // 累计重新进组重试次数
+    uint64_t         reconnect_retries;         // 累计重连次数
+    char             endpoint[128];             // 当前连接的地址
+    uint64_t         rtt_ewma_us;               // 当前地址心跳RTT平滑值(us)
+    uint64_t         rtt_min_us;                // 当前地址心跳RTT最小值(us)
+    uint64_t         rtt_max_us;                // 当前地址心跳RTT最大值(us)
+    uint64_t         rtt_samples;               // 当前地址心跳RTT采样次数
+    uint64_t         standby_failovers;         // 切换到热备连接的次数
+    uint64_t         compressed_msgs;           // 开启压缩后按压缩发送的消息数
+    uint64_t         compress_raw_bytes;        // 按压缩发送的消息原始字节数
+    uint64_t         compress_zip_bytes;        // 按抽样压缩率估算的压缩后字节数
+    uint64_t         dropped_events;            // 事件队列满时丢弃的事件数
+    uint64_t         elk_requests;              // ELK上传请求数
+    uint64_t         elk_failures;              // ELK上传失败的请求数
+    uint64_t         elk_raw_bytes;             // ELK上传内容压缩前的字节数
+    uint64_t         elk_sent_bytes;            // ELK上传实际发送的字节数
+    uint64_t         elk_spool_bytes;           // 磁盘暂存的待上传ELK日志字节数
+    uint64_t         elk_spool_dropped;         // 暂存文件满时丢弃的ELK日志数
+    uint64_t         elk_dropped;               // 队列满、重试失败或超长丢弃的ELK日志数
+    uint64_t         elk_merged;                // 合并到已有记录中的ELK日志数
+    uint64_t         elk_sampled_out;           // 采样未上传的ELK日志数
+    uint64_t         elk_truncated;             // 字段超长被截断的ELK日志数
+    uint32_t         conn_count;                // 连接池中的连接数
+    PushSDKConnStats conns[PS_MAX_CONN_STATS];  // 连接池中各连接的统计
+} PushSDKStats;
+
 /**
 @brief SDK全局事件回调函数
 @param [in] type 事件类型
@@ -86,6 +134,8 @@ typedef void (*PushSDKEventCB)(PushSDKCBType  type,
 
 typedef void* PS_HANDLER;
 
+typedef void* PS_SESSION;
+
 /**
 @brief SDK用户消息回调
 @param [in] data 消息数据
@@ -126,8 +176,10 @@ PS_EXPORT PushSDKRetCode PushSDKInitialize(uint32_t       uid,
                                            PushSDKEventCB cb_func,
                                            void*          cb_arg);
 
-// @brief     去初始化，可重复调用，非线程安全
-PS_EXPORT void PushSDKDestroy(void);
+// @brief     去初始化，可重复调用，非线程安全，
+// 不能在SDK回调中调用，否则返回PS_RET_IN_SDK_THREAD
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKDestroy(void);
 
 // @brief     同步登录，必须在SDK初始化之后调用，重复调用返回，线程安全
 // PS_RET_ALREADY_LOGIN
@@ -151,12 +203,147 @@ PS_EXPORT PushSDKRetCode PushSDKJoinGroup(PushSDKGroupInfo* group);
 // @return    SDK API返回码
 PS_EXPORT PushSDKRetCode PushSDKLeaveGroup(PushSDKGroupInfo* group);
 
+// @brief     同步登录，可指定本次调用的超时时间，其余同PushSDKLogin
+// @param[in] user 用户信息
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKLoginWithTimeout(PushSDKUserInfo* user,
+                                                 int              timeout_ms);
+
+// @brief     同步登出，可指定本次调用的超时时间，其余同PushSDKLogout
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKLogoutWithTimeout(int timeout_ms);
+
+// @brief     同步进组，可指定本次调用的超时时间，其余同PushSDKJoinGroup
+// @param[in] group 组信息
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode
+          PushSDKJoinGroupWithTimeout(PushSDKGroupInfo* group, int timeout_ms);
+
+// @brief     同步离组，可指定本次调用的超时时间，其余同PushSDKLeaveGroup
+// @param[in] group 组信息
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode
+          PushSDKLeaveGroupWithTimeout(PushSDKGroupInfo* group, int timeout_ms);
+
+// @brief
+// 取消所有该类型、尚未返回的调用(包括所有组的加组、离组调用)，
+// 被取消的同步调用立即返回PS_RET_CALL_CANCELED，
+// 异步调用以PS_CB_EVENT_CANCELED回调，错误码为RES_ECANCELED(499)，
+// SDK内部的重登、重新进组不会被取消，可在其他线程调用，线程安全
+// @param[in] type 调用类型(登录、登出、加组、离组)
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKCancelCall(PushSDKCBType type);
+
+// @brief
+// 只取消该组、该类型尚未返回的加组或离组调用，group为空时同PushSDKCancelCall，
+// 其余同PushSDKCancelCall
+// @param[in] type 调用类型(加组、离组)
+// @param[in] group 组信息
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKCancelGroupCall(PushSDKCBType     type,
+                                                PushSDKGroupInfo* group);
+
 // @brief
 // 同步调用返回PS_RET_CALL_FAILED的时候，立刻调用此函数可获得错误描述及返回码，线程安全
 // @param[out] desc 服务器返回的错误描述，使用后需要手动free
 // @param[out] code 服务器返回的错误码
 PS_EXPORT void PushSDKGetError(char** desc, int* code);
 
+// @brief
+// 设置配置项，key为配置名，如"grpc_cq_timeout_ms"，字符串配置的value直接使用，
+// 其他配置的value为JSON文本，如"20"、"true"、"[15000,14000]"。
+// 应在SDK初始化之前调用，初始化之后只能修改超时、间隔、批量大小等可热更新的配置，
+// 其余返回PS_RET_CONFIG_NOT_HOT，线程安全
+// @param[in] key 配置名
+// @param[in] value 配置值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKSetConfig(const char* key, const char* value);
+
+// @brief
+// 从JSON文件加载配置，文件内容为{"配置名": 配置值}，单项失败不影响其他配置项，
+// 返回第一个失败的错误码，其余同PushSDKSetConfig
+// @param[in] path 配置文件路径
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKLoadConfig(const char* path);
+
+// @brief
+// 获取SDK运行统计，必须在SDK初始化之后调用，线程安全
+// @param[out] stats 统计信息
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKGetStats(PushSDKStats* stats);
+
+// @brief
+// 创建会话，必须在SDK初始化之后调用，线程安全。
+// 每个会话使用独立的uid登录，所有会话共享连接及SDK内部线程，appid、appkey与初始化时相同
+// @param[in] uid 用户ID
+// @param[in] cb_func 会话事件回调函数
+// @param[in] cb_arg 会话事件回调函数args
+// @param[out] session 会话句柄
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKSessionCreate(uint32_t       uid,
+                                              PushSDKEventCB cb_func,
+                                              void*          cb_arg,
+                                              PS_SESSION*    session);
+
+// @brief
+// 销毁会话，会话句柄随即失效，不能在SDK回调中调用，
+// 否则返回PS_RET_IN_SDK_THREAD，会话保持有效
+// @param[in] session 会话句柄
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKSessionDestroy(PS_SESSION session);
+
+// @brief     会话同步登录，同一会话的调用串行执行，其余同PushSDKLoginWithTimeout
+// @param[in] session 会话句柄
+// @param[in] user 用户信息
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKSessionLogin(PS_SESSION       session,
+                                             PushSDKUserInfo* user,
+                                             int              timeout_ms);
+
+// @brief     会话同步登出，其余同PushSDKLogoutWithTimeout
+// @param[in] session 会话句柄
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKSessionLogout(PS_SESSION session,
+                                              int        timeout_ms);
+
+// @brief     会话同步进组，其余同PushSDKJoinGroupWithTimeout
+// @param[in] session 会话句柄
+// @param[in] group 组信息
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKSessionJoinGroup(PS_SESSION        session,
+                                                 PushSDKGroupInfo* group,
+                                                 int               timeout_ms);
+
+// @brief     会话同步离组，其余同PushSDKLeaveGroupWithTimeout
+// @param[in] session 会话句柄
+// @param[in] group 组信息
+// @param[in] timeout_ms 超时时间(ms)，小于等于0时使用默认值
+// @return    SDK API返回码
+PS_EXPORT PushSDKRetCode PushSDKSessionLeaveGroup(PS_SESSION        session,
+                                                  PushSDKGroupInfo* group,
+                                                  int               timeout_ms);
+
+// @brief
+// 会话同步调用返回PS_RET_CALL_FAILED的时候，立刻调用此函数可获得错误描述及返回码
+// @param[in] session 会话句柄
+// @param[out] desc 服务器返回的错误描述，使用后需要手动free
+// @param[out] code 服务器返回的错误码
+PS_EXPORT void
+PushSDKSessionGetError(PS_SESSION session, char** desc, int* code);
+
+// @brief
+// 生成会话的句柄，线程安全，回调函数设置方式与PushSDKCreateHandler生成的句柄相同
+// @param[in] session 会话句柄
+// @return 句柄，用于添加该会话的回调函数
+PS_EXPORT PS_HANDLER PushSDKSessionCreateHandler(PS_SESSION session);
+
 // @brief
 // 生成句柄，线程安全
 // @return 句柄，用于添加回调函数
@@ -0,0 +1,77 @@
+#include <common/clock.h>
+
+#include <cstring>
+#include <ctime>
+
+namespace edu {
+
+CachedClock::CachedClock()
+{
+    sec_ = -1;
+    seq_ = 0;
+    for (std::atomic<uint64_t>& word : words_) {
+        word = 0;
+    }
+    refresh(static_cast<int64_t>(time(nullptr)));
+}
+
+Timestamp CachedClock::Now()
+{
+    int64_t now = static_cast<int64_t>(time(nullptr));
+    if (now != sec_.load(std::memory_order_acquire)) {
+        refresh(now);
+    }
+
+    Timestamp ts;
+    uint64_t  words[3];
+    for (;;) {
+        uint32_t seq = seq_.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        for (int i = 0; i < 3; i++) {
+            words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+
+    memcpy(ts.str, words, sizeof(words));
+    ts.str[sizeof(ts.str) - 1] = '\0';
+    return ts;
+}
+
+void CachedClock::refresh(int64_t sec)
+{
+    // 其他线程正在更新时直接返回，读到的最多是上一秒的时间
+    std::unique_lock<std::mutex> lock(refresh_mux_, std::try_to_lock);
+    if (!lock.owns_lock() || sec_.load(std::memory_order_relaxed) == sec) {
+        return;
+    }
+
+    time_t    t = static_cast<time_t>(sec);
+    struct tm tm;
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+
+    char buf[sizeof(words_)] = {0};
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+
+    uint64_t words[3];
+    memcpy(words, buf, sizeof(words));
+
+    seq_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < 3; i++) {
+        words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    seq_.fetch_add(1, std::memory_order_release);
+    sec_.store(sec, std::memory_order_release);
+}
+
+}  // namespace edu
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef EDU_PUSH_SDK_CLOCK_H
+#define EDU_PUSH_SDK_CLOCK_H
+
+#include <common/singleton.h>
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+namespace edu {
+
+// "%Y-%m-%d %H:%M:%S"格式的时间字符串，按值传递，不分配内存
+struct Timestamp
+{
+    Timestamp()
+    {
+        str[0] = '\0';
+    }
+
+    char str[24];
+};
+
+// 秒级精度的本地时间缓存，每秒只在第一个调用的线程格式化一次，
+// 其余调用只读取缓存，不调用localtime，不加锁，线程安全
+class CachedClock : public Singleton<CachedClock> {
+    friend class Singleton<CachedClock>;
+
+  public:
+    virtual ~CachedClock() {}
+
+  protected:
+    CachedClock();
+
+  public:
+    Timestamp Now();
+
+  private:
+    void refresh(int64_t sec);
+
+  private:
+    // 缓存的时间字符串按8字节原子变量存放，seq_为奇数时正在更新
+    std::atomic<int64_t>  sec_;
+    std::atomic<uint32_t> seq_;
+    std::atomic<uint64_t> words_[3];
+    std::mutex            refresh_mux_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
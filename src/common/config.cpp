@@ -0,0 +1,444 @@
+#include <common/config.h>
+#include <common/log.h>
+#include <push_sdk.h>
+
+#include <json/json.h>
+
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+
+#define ENV_CONFIG_FILE "PUSH_SDK_CONFIG_FILE"
+#define ENV_CONFIG_PREFIX "PUSH_SDK_"
+
+// 注册配置项，hot为true表示SDK初始化后仍可修改
+#define CONFIG_ITEM(name, hot) items_[#name] = make_item(&name, hot)
+// 注册由ELK上传线程读取的配置项
+#define ELK_CONFIG_ITEM(name, hot)                 \
+    do {                                           \
+        items_[#name]     = make_item(&name, hot); \
+        items_[#name].elk = true;                  \
+    } while (0)
+// 设置数值配置项的取值范围
+#define CONFIG_RANGE(name, lo, hi) \
+    do {                           \
+        items_[#name].min = lo;    \
+        items_[#name].max = hi;    \
+    } while (0)
+
+namespace edu {
+
+static bool in_range(const ConfigItem& item, double value)
+{
+    return value >= item.min && value <= item.max;
+}
+
+static ConfigItem make_item(ConfigType type, void* ptr, bool hot)
+{
+    ConfigItem item;
+    item.type = type;
+    item.ptr  = ptr;
+    item.hot  = hot;
+    return item;
+}
+
+static ConfigItem make_item(int* ptr, bool hot)
+{
+    return make_item(ConfigType::INT, ptr, hot);
+}
+
+static ConfigItem make_item(std::atomic<int>* ptr, bool hot)
+{
+    return make_item(ConfigType::ATOMIC_INT, ptr, hot);
+}
+
+static ConfigItem make_item(int64_t* ptr, bool hot)
+{
+    return make_item(ConfigType::INT64, ptr, hot);
+}
+
+static ConfigItem make_item(double* ptr, bool hot)
+{
+    return make_item(ConfigType::DOUBLE, ptr, hot);
+}
+
+static ConfigItem make_item(bool* ptr, bool hot)
+{
+    return make_item(ConfigType::BOOL, ptr, hot);
+}
+
+static ConfigItem make_item(std::string* ptr, bool hot)
+{
+    return make_item(ConfigType::STRING, ptr, hot);
+}
+
+static ConfigItem make_item(std::vector<int>* ptr, bool hot)
+{
+    return make_item(ConfigType::INT_LIST, ptr, hot);
+}
+
+static ConfigItem make_item(std::vector<std::string>* ptr, bool hot)
+{
+    return make_item(ConfigType::STRING_LIST, ptr, hot);
+}
+
+static ConfigItem make_item(std::map<std::string, std::string>* ptr, bool hot)
+{
+    return make_item(ConfigType::STRING_MAP, ptr, hot);
+}
+
+static ConfigItem make_item(std::map<std::string, double>* ptr, bool hot)
+{
+    return make_item(ConfigType::DOUBLE_MAP, ptr, hot);
+}
+
+Config::Config()
+{
+    running_     = false;
+    elk_running_ = false;
+
+    CONFIG_ITEM(logger_flush_interval_sec, false);
+    CONFIG_ITEM(grpc_log_on_console, false);
+    CONFIG_ITEM(grpc_log_level, false);
+    CONFIG_ITEM(sdk_log_on_console, false);
+    CONFIG_ITEM(sdk_log_level, false);
+    CONFIG_ITEM(sdk_log_enable_grpc, false);
+    CONFIG_ITEM(front_envoy_host, false);
+    CONFIG_ITEM(front_envoy_hosts, false);
+    CONFIG_ITEM(front_envoy_ports, false);
+    CONFIG_ITEM(grpc_uds_endpoints, false);
+
+    CONFIG_ITEM(heart_beat_interval, false);
+    CONFIG_ITEM(rtt_ewma_alpha, false);
+
+    CONFIG_ITEM(grpc_keep_alive_time, false);
+    CONFIG_ITEM(grpc_keep_alive_timeout, false);
+    CONFIG_ITEM(grpc_keep_alive_permit_without_calls, false);
+    CONFIG_ITEM(grpc_max_pings_without_data, false);
+    CONFIG_ITEM(grpc_min_sent_ping_interval_without_data, false);
+    CONFIG_ITEM(grpc_cq_timeout_ms, true);
+    CONFIG_ITEM(grpc_client_pool_size, false);
+    CONFIG_ITEM(grpc_wait_connect_ms, true);
+    CONFIG_ITEM(grpc_session_close_timeout_ms, false);
+    CONFIG_ITEM(channel_state_debounce_ms, true);
+    CONFIG_ITEM(grpc_connect_race_stagger_ms, true);
+    CONFIG_ITEM(grpc_connect_race_width, true);
+    CONFIG_ITEM(grpc_standby_enable, false);
+    CONFIG_ITEM(grpc_standby_check_interval_ms, true);
+    CONFIG_ITEM(grpc_flow_control_preset, false);
+    CONFIG_ITEM(grpc_http2_bdp_probe, false);
+    CONFIG_ITEM(grpc_http2_stream_lookahead_bytes, false);
+    CONFIG_ITEM(grpc_http2_write_buffer_size, false);
+    CONFIG_ITEM(grpc_max_receive_message_length, false);
+    CONFIG_ITEM(grpc_lb_policy, false);
+    CONFIG_ITEM(dns_cache_ttl_ms, true);
+    CONFIG_ITEM(dns_cache_retry_ms, true);
+    CONFIG_ITEM(grpc_compression_algorithm, false);
+    CONFIG_ITEM(grpc_compression_min_bytes, true);
+    CONFIG_ITEM(grpc_compression_sample_interval, true);
+
+    CONFIG_ITEM(call_timeout_interval, true);
+    CONFIG_ITEM(call_check_timeout_interval, true);
+
+    // 退避参数在创建重试策略时读取，运行中修改不会生效
+    CONFIG_ITEM(retry_backoff_base_ms, false);
+    CONFIG_ITEM(retry_backoff_cap_ms, false);
+    CONFIG_ITEM(retry_backoff_multiplier, false);
+    CONFIG_ITEM(retry_budget_per_session, false);
+
+    ELK_CONFIG_ITEM(elk_project_name, false);
+    ELK_CONFIG_ITEM(elk_region, false);
+    ELK_CONFIG_ITEM(elk_log_store, false);
+    ELK_CONFIG_ITEM(elk_source, false);
+    ELK_CONFIG_ITEM(elk_encode, false);
+    ELK_CONFIG_ITEM(elk_upload_interval_ms, true);
+    ELK_CONFIG_ITEM(elk_upload_min_size, true);
+    ELK_CONFIG_ITEM(elk_upload_max_size, true);
+    ELK_CONFIG_ITEM(elk_upload_batch_bytes, true);
+    ELK_CONFIG_ITEM(elk_upload_retry_base_ms, false);
+    ELK_CONFIG_ITEM(elk_upload_retry_cap_ms, false);
+    ELK_CONFIG_ITEM(elk_upload_max_attempts, true);
+    ELK_CONFIG_ITEM(elk_upload_max_pending_batches, true);
+    ELK_CONFIG_ITEM(elk_upload_flush_timeout_ms, true);
+    ELK_CONFIG_ITEM(elk_aggregate_window_ms, true);
+    ELK_CONFIG_ITEM(elk_sample_rates, false);
+    ELK_CONFIG_ITEM(elk_sink, false);
+    ELK_CONFIG_ITEM(elk_sink_address, false);
+    ELK_CONFIG_ITEM(elk_upload_host, false);
+    ELK_CONFIG_ITEM(elk_upload_path, false);
+    ELK_CONFIG_ITEM(elk_upload_headers, false);
+    ELK_CONFIG_ITEM(elk_http_keep_alive_idle_ms, true);
+    ELK_CONFIG_ITEM(elk_upload_compression, false);
+    ELK_CONFIG_ITEM(elk_upload_compress_min_bytes, true);
+    ELK_CONFIG_ITEM(elk_spool_max_bytes, false);
+    ELK_CONFIG_ITEM(elk_spool_drain_bytes, true);
+
+    CONFIG_RANGE(logger_flush_interval_sec, 1, 3600);
+    CONFIG_RANGE(front_envoy_ports, 1, 65535);
+    CONFIG_RANGE(heart_beat_interval, 100, 600 * 1000);
+    CONFIG_RANGE(rtt_ewma_alpha, 0.001, 1);
+    CONFIG_RANGE(grpc_keep_alive_time, 1, INT_MAX);
+    CONFIG_RANGE(grpc_keep_alive_timeout, 1, INT_MAX);
+    CONFIG_RANGE(grpc_keep_alive_permit_without_calls, 0, 1);
+    CONFIG_RANGE(grpc_max_pings_without_data, 0, INT_MAX);
+    CONFIG_RANGE(grpc_min_sent_ping_interval_without_data, 0, INT_MAX);
+    CONFIG_RANGE(grpc_cq_timeout_ms, 1, 1000);
+    CONFIG_RANGE(grpc_client_pool_size, 1, 64);
+    CONFIG_RANGE(grpc_wait_connect_ms, 1, INT_MAX);
+    CONFIG_RANGE(grpc_session_close_timeout_ms, 0, 60 * 1000);
+    CONFIG_RANGE(channel_state_debounce_ms, 0, INT_MAX);
+    CONFIG_RANGE(grpc_connect_race_stagger_ms, 0, INT_MAX);
+    CONFIG_RANGE(grpc_connect_race_width, 1, 64);
+    CONFIG_RANGE(grpc_standby_check_interval_ms, 1, INT_MAX);
+    CONFIG_RANGE(grpc_http2_bdp_probe, -1, 1);
+    CONFIG_RANGE(grpc_http2_stream_lookahead_bytes, -1, INT_MAX);
+    CONFIG_RANGE(grpc_http2_write_buffer_size, -1, INT_MAX);
+    CONFIG_RANGE(grpc_max_receive_message_length, -1, INT_MAX);
+    CONFIG_RANGE(dns_cache_ttl_ms, 1, INT_MAX);
+    CONFIG_RANGE(dns_cache_retry_ms, 1, INT_MAX);
+    CONFIG_RANGE(grpc_compression_min_bytes, 0, INT_MAX);
+    CONFIG_RANGE(grpc_compression_sample_interval, 0, INT_MAX);
+    CONFIG_RANGE(call_timeout_interval, 1, INT_MAX);
+    CONFIG_RANGE(call_check_timeout_interval, 1, 60 * 1000);
+    CONFIG_RANGE(retry_backoff_base_ms, 1, INT_MAX);
+    CONFIG_RANGE(retry_backoff_cap_ms, 1, INT_MAX);
+    CONFIG_RANGE(retry_backoff_multiplier, 1, 100);
+    CONFIG_RANGE(retry_budget_per_session, 0, INT_MAX);
+    CONFIG_RANGE(elk_encode, 1, 2);
+    CONFIG_RANGE(elk_upload_interval_ms, 1, INT_MAX);
+    CONFIG_RANGE(elk_upload_min_size, 0, INT_MAX);
+    CONFIG_RANGE(elk_upload_max_size, 1, INT_MAX);
+    CONFIG_RANGE(elk_upload_batch_bytes, 1, INT_MAX);
+    CONFIG_RANGE(elk_upload_retry_base_ms, 1, INT_MAX);
+    CONFIG_RANGE(elk_upload_retry_cap_ms, 1, INT_MAX);
+    CONFIG_RANGE(elk_upload_max_attempts, 1, INT_MAX);
+    CONFIG_RANGE(elk_upload_max_pending_batches, 1, INT_MAX);
+    CONFIG_RANGE(elk_upload_flush_timeout_ms, 0, INT_MAX);
+    CONFIG_RANGE(elk_aggregate_window_ms, 0, INT_MAX);
+    CONFIG_RANGE(elk_sample_rates, 0, 1);
+    CONFIG_RANGE(elk_http_keep_alive_idle_ms, 0, INT_MAX);
+    CONFIG_RANGE(elk_upload_compress_min_bytes, 0, INT_MAX);
+    CONFIG_RANGE(elk_spool_max_bytes, 0, INT_MAX);
+    CONFIG_RANGE(elk_spool_drain_bytes, 1, INT_MAX);
+
+    LoadEnv();
+}
+
+int Config::Set(const std::string& key, const std::string& value)
+{
+    auto it = items_.find(key);
+    if (it == items_.end()) {
+        log_w("unknown config key {}", key);
+        return PS_RET_CONFIG_INVALID;
+    }
+
+    Json::Value v;
+    if (it->second.type == ConfigType::STRING) {
+        v = value;
+    }
+    else {
+        Json::Reader reader;
+        if (!reader.parse(value, v, false)) {
+            log_w("config {} value {} is not valid json", key, value);
+            return PS_RET_CONFIG_INVALID;
+        }
+    }
+
+    return set(key, v);
+}
+
+int Config::LoadFile(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        log_w("open config file {} failed", path);
+        return PS_RET_CONFIG_INVALID;
+    }
+
+    Json::Value  root;
+    Json::Reader reader;
+    if (!reader.parse(in, root, false) || !root.isObject()) {
+        log_w("config file {} is not a json object", path);
+        return PS_RET_CONFIG_INVALID;
+    }
+
+    int ret = PS_RET_SUCCESS;
+    for (const std::string& key : root.getMemberNames()) {
+        int r = set(key, root[key]);
+        if (r != PS_RET_SUCCESS && ret == PS_RET_SUCCESS) {
+            ret = r;
+        }
+    }
+
+    log_i("config file {} loaded. ret={}", path, ret);
+    return ret;
+}
+
+void Config::LoadEnv()
+{
+    const char* path = getenv(ENV_CONFIG_FILE);
+    if (path && *path) {
+        LoadFile(path);
+    }
+
+    for (auto it = items_.begin(); it != items_.end(); it++) {
+        std::string name = ENV_CONFIG_PREFIX;
+        for (char c : it->first) {
+            name += static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        }
+
+        const char* value = getenv(name.c_str());
+        if (value) {
+            Set(it->first, value);
+        }
+    }
+}
+
+void Config::SetRunning(bool running)
+{
+    std::unique_lock<std::mutex> lock(mux_);
+    running_ = running;
+}
+
+void Config::SetELKRunning(bool running)
+{
+    std::unique_lock<std::mutex> lock(mux_);
+    elk_running_ = running;
+}
+
+int Config::set(const std::string& key, const Json::Value& value)
+{
+    auto it = items_.find(key);
+    if (it == items_.end()) {
+        log_w("unknown config key {}", key);
+        return PS_RET_CONFIG_INVALID;
+    }
+
+    std::unique_lock<std::mutex> lock(mux_);
+
+    const ConfigItem& item = it->second;
+    if ((running_ || (elk_running_ && item.elk)) && !item.hot) {
+        log_w("config {} can not be changed after initialization", key);
+        return PS_RET_CONFIG_NOT_HOT;
+    }
+
+    bool ok = true;
+    switch (item.type) {
+        case ConfigType::INT: {
+            if ((ok = value.isInt() && in_range(item, value.asInt()))) {
+                *static_cast<int*>(item.ptr) = value.asInt();
+            }
+            break;
+        }
+        case ConfigType::ATOMIC_INT: {
+            if ((ok = value.isInt() && in_range(item, value.asInt()))) {
+                static_cast<std::atomic<int>*>(item.ptr)->store(value.asInt());
+            }
+            break;
+        }
+        case ConfigType::INT64: {
+            if ((ok = value.isInt64() &&
+                      in_range(item, static_cast<double>(value.asInt64())))) {
+                *static_cast<int64_t*>(item.ptr) = value.asInt64();
+            }
+            break;
+        }
+        case ConfigType::DOUBLE: {
+            if ((ok = value.isNumeric() && in_range(item, value.asDouble()))) {
+                *static_cast<double*>(item.ptr) = value.asDouble();
+            }
+            break;
+        }
+        case ConfigType::BOOL: {
+            // 兼容0/1
+            if ((ok = value.isBool() || value.isInt())) {
+                *static_cast<bool*>(item.ptr) = value.asBool();
+            }
+            break;
+        }
+        case ConfigType::STRING: {
+            if ((ok = value.isString())) {
+                *static_cast<std::string*>(item.ptr) = value.asString();
+            }
+            break;
+        }
+        case ConfigType::INT_LIST: {
+            std::vector<int> list;
+            if (!(ok = value.isArray() && !value.empty())) {
+                break;
+            }
+            for (Json::ArrayIndex i = 0; i < value.size(); i++) {
+                if (!(ok = value[i].isInt() &&
+                           in_range(item, value[i].asInt()))) {
+                    break;
+                }
+                list.push_back(value[i].asInt());
+            }
+            if (ok) {
+                *static_cast<std::vector<int>*>(item.ptr) = list;
+            }
+            break;
+        }
+        case ConfigType::STRING_LIST: {
+            std::vector<std::string> list;
+            if (!(ok = value.isArray())) {
+                break;
+            }
+            for (Json::ArrayIndex i = 0; i < value.size(); i++) {
+                if (!(ok = value[i].isString())) {
+                    break;
+                }
+                list.push_back(value[i].asString());
+            }
+            if (ok) {
+                *static_cast<std::vector<std::string>*>(item.ptr) = list;
+            }
+            break;
+        }
+        case ConfigType::STRING_MAP: {
+            std::map<std::string, std::string> map;
+            if (!(ok = value.isObject())) {
+                break;
+            }
+            for (const std::string& k : value.getMemberNames()) {
+                if (!(ok = value[k].isString())) {
+                    break;
+                }
+                map[k] = value[k].asString();
+            }
+            if (ok) {
+                *static_cast<std::map<std::string, std::string>*>(item.ptr) =
+                    map;
+            }
+            break;
+        }
+        case ConfigType::DOUBLE_MAP: {
+            std::map<std::string, double> map;
+            if (!(ok = value.isObject())) {
+                break;
+            }
+            for (const std::string& k : value.getMemberNames()) {
+                if (!(ok = value[k].isNumeric() &&
+                           in_range(item, value[k].asDouble()))) {
+                    break;
+                }
+                map[k] = value[k].asDouble();
+            }
+            if (ok) {
+                *static_cast<std::map<std::string, double>*>(item.ptr) = map;
+            }
+            break;
+        }
+    }
+
+    if (!ok) {
+        log_w("config {} value type mismatch or out of range", key);
+        return PS_RET_CONFIG_INVALID;
+    }
+
+    log_i("config {} updated", key);
+    return PS_RET_SUCCESS;
+}
+
+}  // namespace edu
\ No newline at end of file
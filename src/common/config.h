@@ -3,11 +3,58 @@
 
 #include <common/singleton.h>
 
+#include <atomic>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
+namespace Json {
+class Value;
+}
+
 namespace edu {
+
+enum class ConfigType {
+    INT         = 0,
+    INT64       = 1,
+    DOUBLE      = 2,
+    BOOL        = 3,
+    STRING      = 4,
+    INT_LIST    = 5,
+    STRING_MAP  = 6,
+    STRING_LIST = 7,
+    DOUBLE_MAP  = 8,
+    ATOMIC_INT  = 9
+};
+
+struct ConfigItem
+{
+    ConfigItem()
+    {
+        type = ConfigType::INT;
+        ptr  = nullptr;
+        hot  = false;
+        elk  = false;
+        min  = std::numeric_limits<double>::lowest();
+        max  = std::numeric_limits<double>::max();
+    }
+
+    ConfigType type;
+    void*      ptr;
+    // SDK初始化后是否允许修改，只有数值类型且每次使用时都重新读取的配置项可以热更新，
+    // 热更新的配置项为std::atomic<int>，读取方不加锁
+    bool hot;
+    // 是否由ELK上传线程读取，上传线程运行期间(PushSDKDestroy之后仍在运行)不可修改
+    bool elk;
+    // 数值类型(列表、map中的每个值)的取值范围，超出时拒绝修改
+    double min;
+    double max;
+};
+
+// 下面的成员初始值为默认配置，创建时依次从PUSH_SDK_CONFIG_FILE指定的JSON文件、
+// PUSH_SDK_<KEY大写>环境变量加载，之后可通过PushSDKSetConfig、PushSDKLoadConfig覆盖
 class Config : public Singleton<Config> {
     friend Singleton<Config>;
 
@@ -15,7 +62,31 @@ class Config : public Singleton<Config> {
     virtual ~Config() {}
 
   protected:
-    Config() {}
+    Config();
+
+  public:
+    // 按key设置配置项，string类型的value直接使用，其他类型的value为JSON文本，
+    // 如"3000"、"true"、"[15000,14000]"、"{\"referer\":\"www.yy.com\"}"，线程安全
+    virtual int Set(const std::string& key, const std::string& value);
+    // 从JSON文件加载配置，文件内容为{key: value}，单项失败不影响其他配置项，
+    // 返回第一个失败的错误码
+    virtual int LoadFile(const std::string& path);
+    // 从环境变量加载配置，PUSH_SDK_CONFIG_FILE指定配置文件，
+    // PUSH_SDK_<KEY大写>指定单个配置项，如PUSH_SDK_GRPC_CQ_TIMEOUT_MS=20
+    virtual void LoadEnv();
+    // SDK初始化后置为true，之后只能修改可热更新的配置项
+    virtual void SetRunning(bool running);
+    // ELK上传线程启动后置为true，之后只能修改可热更新的ELK配置项
+    virtual void SetELKRunning(bool running);
+
+  private:
+    int set(const std::string& key, const Json::Value& value);
+
+  private:
+    std::map<std::string, ConfigItem> items_;
+    std::mutex                        mux_;
+    bool                              running_;
+    bool                              elk_running_;
 
   public:
 #ifdef __linux__
@@ -54,9 +125,16 @@ class Config : public Singleton<Config> {
     std::string front_envoy_host = "front.100.com";
 #endif
     std::vector<int> front_envoy_ports = {15000, 14000, 5000, 1500, 500};
+    // 其他front_envoy 域名，与front_envoy_host一起和端口组合成地址列表
+    std::vector<std::string> front_envoy_hosts = {};
+    // 本机sidecar的unix域套接字地址，如"unix:/var/run/envoy/push.sock"，
+    // 排在TCP地址之前优先连接，不可用时由连接竞速及热备连接切换到TCP地址
+    std::vector<std::string> grpc_uds_endpoints = {};
 
     // 与PushGateway心跳间隔(ms)
     int64_t heart_beat_interval = 3 * 1000;
+    // 心跳RTT EWMA平滑系数
+    double rtt_ewma_alpha = 0.125;
 
     // GRPC心跳间隔(ms)
     int grpc_keep_alive_time = 1000;
@@ -69,14 +147,66 @@ class Config : public Singleton<Config> {
     // GRPC发送连续的ping帧而不接收任何数据之间的最短时间(ms)
     int grpc_min_sent_ping_interval_without_data = 1000;
     // GRPC CQ等待事件超时时间(ms)
-    int grpc_cq_timeout_ms = 50;
-    // GRPC 等待连接成功的时间(ms)
-    int grpc_wait_connect_ms = 500;
+    std::atomic<int> grpc_cq_timeout_ms{50};
+    // GRPC 所有会话共享的连接数，每个连接使用一个CQ线程及独立的HTTP/2连接，
+    // 会话按suid哈希分配到连接上
+    int grpc_client_pool_size = 1;
+    // GRPC 销毁会话时等待服务器结束stream的超时时间(ms)，超时后取消stream
+    int grpc_session_close_timeout_ms = 1000;
+    // GRPC 单次等待通道状态变化的超时时间(ms)，状态变化时立即返回，
+    // 超时只是兜底，超时后重新检查通道状态
+    std::atomic<int> grpc_wait_connect_ms{60 * 1000};
+    // 通道状态保持不变超过该时长(ms)才回调PushSDKConnStateCB，过滤抖动
+    std::atomic<int> channel_state_debounce_ms{300};
+    // GRPC 连接竞速时，相邻两个地址发起连接的间隔(ms)
+    std::atomic<int> grpc_connect_race_stagger_ms{250};
+    // GRPC 连接竞速时，同时连接的最大地址数
+    std::atomic<int> grpc_connect_race_width{3};
+    // GRPC 是否保持一个到其他地址的热备连接，主连接断开时直接切换
+    bool grpc_standby_enable = false;
+    // GRPC 热备连接状态检查间隔(ms)
+    std::atomic<int> grpc_standby_check_interval_ms{1000};
+    // GRPC HTTP/2流控预设(实验性)："mobile"(高延迟移动网络)、
+    // "datacenter"(低延迟大带宽)、"low-memory"(内存受限)，为空时使用GRPC默认值。
+    // 预设中的数值是估计值，未经实测验证，默认不启用，需在目标网络上测量后再开启
+    std::string grpc_flow_control_preset = "";
+    // 以下流控参数小于0时使用预设值，预设也未指定时使用GRPC默认值
+    // GRPC 是否开启BDP探测动态调整流控窗口(1为enabled 0为disabled)
+    int grpc_http2_bdp_probe = -1;
+    // GRPC stream初始接收窗口(bytes)
+    int grpc_http2_stream_lookahead_bytes = -1;
+    // GRPC 写缓冲大小(bytes)，超过后暂停写入
+    int grpc_http2_write_buffer_size = -1;
+    // GRPC 接收消息最大长度(bytes)
+    int grpc_max_receive_message_length = -1;
+    // GRPC 负载均衡策略："pick_first"时每个解析出的地址单独参与连接竞速，
+    // "round_robin"时同一端口的所有地址组成一个通道，stream分散到各个网关
+    std::string grpc_lb_policy = "pick_first";
+    // 域名解析缓存刷新间隔(ms)，连接时只使用缓存的结果，不等待解析
+    std::atomic<int> dns_cache_ttl_ms{60 * 1000};
+    // 域名解析失败后重试间隔(ms)
+    std::atomic<int> dns_cache_retry_ms{5000};
+    // GRPC 通道默认压缩算法："none"、"gzip"、"deflate"，服务器不支持时应保持"none"
+    std::string grpc_compression_algorithm = "none";
+    // GRPC 开启压缩时，序列化后小于该大小(bytes)的消息不压缩直接发送
+    std::atomic<int> grpc_compression_min_bytes{512};
+    // GRPC 每隔多少条压缩消息抽样一条估算压缩率(0为不统计)，
+    // 抽样消息在获取统计时于调用者线程上压缩
+    std::atomic<int> grpc_compression_sample_interval{16};
 
     // PushGateway call超时时长(ms)
-    int call_timeout_interval = 3000;
+    std::atomic<int> call_timeout_interval{3000};
     // PushGateway 检测超时间隔(ms)
-    int call_check_timeout_interval = 500;
+    std::atomic<int> call_check_timeout_interval{500};
+
+    // 重登、重新进组、重连退避基础时长(ms)
+    int retry_backoff_base_ms = 200;
+    // 重登、重新进组、重连退避最大时长(ms)
+    int retry_backoff_cap_ms = 30 * 1000;
+    // 重登、重新进组、重连退避倍数
+    double retry_backoff_multiplier = 2.0;
+    // 一次登录会话内重登、重新进组的最大重试次数(0为不限制)
+    int retry_budget_per_session = 20;
 
     // ELK project
     std::string elk_project_name = "100edu-signal-platform";
@@ -89,15 +219,49 @@ class Config : public Singleton<Config> {
     // ELK encode 1代表base64，2代表URLEncode
     int elk_encode = 2;
     // ELK upload interval
-    int elk_upload_interval_ms = 5000;
+    std::atomic<int> elk_upload_interval_ms{5000};
     // ELK upload min size
-    int elk_upload_min_size = 5;
+    std::atomic<int> elk_upload_min_size{5};
     // ELK upload max size
-    int elk_upload_max_size = 100;
+    std::atomic<int> elk_upload_max_size{100};
+    // ELK 待上传日志的估计字节数达到该值时立即上传
+    std::atomic<int> elk_upload_batch_bytes{64 * 1024};
+    // ELK 上传失败后的退避时长(ms)，从base开始每次翻倍直到cap
+    int elk_upload_retry_base_ms = 500;
+    int elk_upload_retry_cap_ms  = 30 * 1000;
+    // ELK 一批日志最多尝试上传的次数，超过后写入暂存文件或丢弃
+    std::atomic<int> elk_upload_max_attempts{5};
+    // ELK 最多保留的待重试批次数
+    std::atomic<int> elk_upload_max_pending_batches{8};
+    // ELK PushSDKDestroy或退出时上传剩余日志的最长时间(ms)
+    std::atomic<int> elk_upload_flush_timeout_ms{2000};
+    // ELK 窗口(ms)内suid、group_info、action、code、msg都相同的日志合并为一条，
+    // 记录次数和首末时间，0为不合并
+    std::atomic<int> elk_aggregate_window_ms{5000};
+    // ELK 按action采样成功(code为0)的日志，如{"Login": 0.1}，未配置的action全部上传
+    std::map<std::string, double> elk_sample_rates;
+    // ELK 日志发送方式："http"、"file"(本地NDJSON文件)、"udp"、"unix"(Unix域套接字)，
+    // 非http方式每条日志一行JSON，不带project、logStore等上报信封，由采集程序补充；
+    // udp方式每条日志一个报文，超过报文大小的日志丢弃并计入elk_dropped
+    std::string elk_sink = "http";
+    // ELK 非http发送方式的地址，file为文件路径(为空时写到日志目录)，
+    // udp为"host:port"，unix为套接字路径
+    std::string elk_sink_address;
     // ELK upload host
     std::string elk_upload_host = "cloud-log.yy.com";
     // ELK upload path
     std::string elk_upload_path = "/api/log/put";
+    // ELK 上传使用持久连接，空闲超过该时长(ms)后重建连接
+    std::atomic<int> elk_http_keep_alive_idle_ms{30 * 1000};
+    // ELK 上传内容压缩："none"、"gzip"、"deflate"，通过Content-Encoding告知服务器
+    std::string elk_upload_compression = "none";
+    // ELK 开启压缩时，小于该大小(bytes)的请求不压缩
+    std::atomic<int> elk_upload_compress_min_bytes{1024};
+    // ELK 上传失败的日志暂存到日志目录下的文件中，文件最大字节数(0为不暂存)，
+    // 多个进程使用同一日志目录时只有先打开文件的进程暂存
+    int elk_spool_max_bytes = 4 * 1024 * 1024;
+    // ELK 网络恢复后每次从暂存文件中读取上传的最大字节数
+    std::atomic<int> elk_spool_drain_bytes{256 * 1024};
     // ELK upload headers
     std::map<std::string, std::string> elk_upload_headers = {
         {"referer", "www.yy.com"},
@@ -0,0 +1,159 @@
+#include <common/config.h>
+#include <common/dns_cache.h>
+#include <common/log.h>
+#include <common/utils.h>
+#include <push_sdk.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#    include <ws2tcpip.h>
+#else
+#    include <arpa/inet.h>
+#    include <netdb.h>
+#    include <sys/socket.h>
+#endif
+
+namespace edu {
+
+DnsCache::DnsCache()
+{
+    init_             = false;
+    thread_           = nullptr;
+    thread_quit_flag_ = true;
+}
+
+DnsCache::~DnsCache()
+{
+    Destroy();
+}
+
+int DnsCache::Initialize()
+{
+    if (init_) {
+        return PS_RET_SUCCESS;
+    }
+
+    thread_quit_flag_ = false;
+    thread_ = std::unique_ptr<std::thread>(new std::thread([this]() {
+        std::unique_lock<std::mutex> lock(mux_);
+        while (!thread_quit_flag_) {
+            int64_t now  = Utils::GetSteadyMilliSeconds();
+            int64_t next = now + Config::Instance()->dns_cache_ttl_ms;
+
+            for (auto& it : entries_) {
+                if (it.second.refresh_ts > now) {
+                    next = std::min(next, it.second.refresh_ts);
+                    continue;
+                }
+
+                // 解析可能耗时较长，期间不持有锁
+                std::string              host = it.first;
+                std::vector<std::string> addresses;
+                lock.unlock();
+                bool ok = resolve(host, addresses);
+                lock.lock();
+
+                Entry& entry = entries_[host];
+                if (ok) {
+                    entry.addresses = addresses;
+                }
+                else {
+                    log_w("resolve {} failed, keep {} cached addresses", host,
+                          entry.addresses.size());
+                }
+                entry.refresh_ts =
+                    Utils::GetSteadyMilliSeconds() +
+                    (ok ? Config::Instance()->dns_cache_ttl_ms :
+                          Config::Instance()->dns_cache_retry_ms);
+                // 解析期间entries_可能有新增，重新遍历
+                next = 0;
+                break;
+            }
+
+            if (next > now && !thread_quit_flag_) {
+                cond_.wait_for(lock, std::chrono::milliseconds(next - now));
+            }
+        }
+    }));
+
+    init_ = true;
+    return PS_RET_SUCCESS;
+}
+
+void DnsCache::Destroy()
+{
+    if (!init_) {
+        return;
+    }
+
+    mux_.lock();
+    thread_quit_flag_ = true;
+    cond_.notify_all();
+    mux_.unlock();
+
+    thread_->join();
+    thread_ = nullptr;
+
+    entries_.clear();
+    init_ = false;
+}
+
+std::vector<std::string> DnsCache::Lookup(const std::string& host)
+{
+    std::unique_lock<std::mutex> lock(mux_);
+
+    auto it = entries_.find(host);
+    if (it != entries_.end()) {
+        return it->second.addresses;
+    }
+
+    entries_[host] = Entry();
+    cond_.notify_one();
+    return std::vector<std::string>();
+}
+
+bool DnsCache::resolve(const std::string&        host,
+                       std::vector<std::string>& addresses)
+{
+    struct addrinfo  hints;
+    struct addrinfo* result = nullptr;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int ret = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    if (ret != 0) {
+        log_w("getaddrinfo {} failed. ret={}", host, ret);
+        return false;
+    }
+
+    for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+        char        buf[INET6_ADDRSTRLEN] = {0};
+        std::string address;
+        if (ai->ai_family == AF_INET) {
+            struct sockaddr_in* sa =
+                reinterpret_cast<struct sockaddr_in*>(ai->ai_addr);
+            inet_ntop(AF_INET, &sa->sin_addr, buf, sizeof(buf));
+            address = buf;
+        }
+        else if (ai->ai_family == AF_INET6) {
+            struct sockaddr_in6* sa =
+                reinterpret_cast<struct sockaddr_in6*>(ai->ai_addr);
+            inet_ntop(AF_INET6, &sa->sin6_addr, buf, sizeof(buf));
+            address = std::string("[") + buf + "]";
+        }
+
+        if (!address.empty() && std::find(addresses.begin(), addresses.end(),
+                                          address) == addresses.end()) {
+            addresses.push_back(address);
+        }
+    }
+    freeaddrinfo(result);
+
+    return !addresses.empty();
+}
+
+}  // namespace edu
\ No newline at end of file
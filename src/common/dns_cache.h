@@ -0,0 +1,61 @@
+#ifndef EDU_PUSH_SDK_DNS_CACHE_H
+#define EDU_PUSH_SDK_DNS_CACHE_H
+
+#include <common/singleton.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace edu {
+
+// 域名解析缓存，后台线程按TTL定期刷新，查询不阻塞。
+// 刷新失败时保留上次的结果，解析结果中IPv6地址带[]，可以直接拼接端口
+class DnsCache : public Singleton<DnsCache> {
+    friend class Singleton<DnsCache>;
+
+  public:
+    virtual ~DnsCache();
+
+  protected:
+    DnsCache();
+
+  public:
+    virtual int  Initialize();
+    virtual void Destroy();
+
+    // 返回缓存的解析结果，尚未解析过的域名返回空并通知后台线程解析，线程安全
+    virtual std::vector<std::string> Lookup(const std::string& host);
+
+  private:
+    struct Entry
+    {
+        Entry()
+        {
+            refresh_ts = 0;
+        }
+
+        std::vector<std::string> addresses;
+        // 下次刷新的时间(ms)
+        int64_t refresh_ts;
+    };
+
+    static bool resolve(const std::string&        host,
+                        std::vector<std::string>& addresses);
+
+  private:
+    bool                         init_;
+    std::map<std::string, Entry> entries_;
+    std::mutex                   mux_;
+    std::condition_variable      cond_;
+    std::unique_ptr<std::thread> thread_;
+    bool                         thread_quit_flag_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
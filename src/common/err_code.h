@@ -21,6 +21,7 @@
 #define RES_EDBNVALID 416 /* 数据库暂时不可用，可能是正在维护 */
 #define RES_NODEMOVED 418 /* 节点已经被转移*/
 #define RES_EOVERTIMES 453 /* 操作次数太多了 */
+#define RES_ECANCELED 499  /* 调用被客户端取消(SDK本地使用，服务器不会返回) */
 
 #define RES_EUNKNOWN 500 /* 出错了.但是原因未明,或是不便透露给你 */
 #define RES_EBUSY 504 /* 后台忙,拒绝处理 */
@@ -1,35 +1,50 @@
+#include <common/config.h>
+#include <common/dns_cache.h>
 #include <common/err_code.h>
 #include <common/http_client.h>
 #include <common/log.h>
+#include <common/utils.h>
 
 #include <evhttp.h>
+#include <zlib.h>
+
+#include <cstring>
 
 namespace edu {
 
-template <typename T>
 static void http_request_cb(struct evhttp_request* req, void* arg)
 {
-    T* t = static_cast<T*>(arg);
-    t->HandleRequestCallBack(req);
+    HttpClient::RequestContext* ctx =
+        static_cast<HttpClient::RequestContext*>(arg);
+    ctx->client->HandleRequestCallBack(ctx, req);
 }
 
-void HttpClient::HandleRequestCallBack(struct evhttp_request* req)
+void HttpClient::HandleRequestCallBack(RequestContext*        ctx,
+                                       struct evhttp_request* req)
 {
-    if (!req) {
-        ok_ = false;
-        return;
+    ctx->ok = req && evhttp_request_get_response_code(req) == RES_SUCCESS;
+    if (!ctx->ok) {
+        conn_broken_ = true;
     }
 
-    if (evhttp_request_get_response_code(req) == RES_SUCCESS) {
-        ok_ = true;
-    }
+    // 持久连接上一直有检测对端关闭的读事件，event_base_dispatch不会自己返回，
+    // 请求完成后主动退出
+    event_base_loopbreak(base_);
 }
 
 HttpClient::HttpClient()
 {
-    base_ = nullptr;
-    init_ = false;
-    ok_   = true;
+    base_         = nullptr;
+    init_         = false;
+    conn_         = nullptr;
+    conn_broken_  = false;
+    conn_used_ts_ = 0;
+    conn_port_    = 0;
+
+    requests_   = 0;
+    failures_   = 0;
+    raw_bytes_  = 0;
+    sent_bytes_ = 0;
 }
 
 HttpClient::~HttpClient()
@@ -37,7 +52,7 @@ HttpClient::~HttpClient()
     Close();
 }
 
-bool HttpClient::Post(const std::string                         ip,
+bool HttpClient::Post(const std::string                         host,
                       int                                       port,
                       const std::string&                        path,
                       const std::map<std::string, std::string>& headers,
@@ -50,49 +65,175 @@ bool HttpClient::Post(const std::string                         ip,
     int                          ret;
     std::unique_lock<std::mutex> lock(mux_);
 
-    evhttp_connection* conn =
-        evhttp_connection_base_new(base_, nullptr, ip.c_str(), port);
+    if (host != conn_host_ || port != conn_port_) {
+        free_connection();
+        conn_host_ = host;
+        conn_port_ = port;
+    }
+
+    requests_++;
+
+    evhttp_connection* conn = get_connection(host, port);
     if (!conn) {
-        log_e("evhttp_connection_base_new failed");
+        failures_++;
         return false;
     }
 
-    evhttp_connection_set_retries(conn, 1);
-    evhttp_connection_set_timeout(conn, 1);
+    RequestContext ctx;
+    ctx.client = this;
 
-    evhttp_request* req = evhttp_request_new(http_request_cb<HttpClient>,
-                                             static_cast<void*>(this));
+    evhttp_request* req =
+        evhttp_request_new(http_request_cb, static_cast<void*>(&ctx));
     if (!req) {
         log_e("evhttp_request_new failed");
+        failures_++;
         return false;
     }
 
     evkeyvalq* output_headers = evhttp_request_get_output_headers(req);
     evhttp_add_header(output_headers, "Content-Type",
                       "text/json;charset=UTF-8");
-    evhttp_add_header(output_headers, "Host", ip.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
+    evhttp_add_header(output_headers, "Host", host.c_str());
+    evhttp_add_header(output_headers, "Connection", "keep-alive");
 
     for (const std::pair<const std::string, std::string>& it : headers) {
         evhttp_add_header(output_headers, it.first.c_str(), it.second.c_str());
     }
 
-    ret = evbuffer_add(req->output_buffer, data.c_str(), data.length());
+    std::string        compressed;
+    std::string        encoding;
+    const std::string& body =
+        compress(data, compressed, encoding) ? compressed : data;
+    if (!encoding.empty()) {
+        evhttp_add_header(output_headers, "Content-Encoding",
+                          encoding.c_str());
+    }
+
+    ret = evbuffer_add(evhttp_request_get_output_buffer(req), body.c_str(),
+                       body.length());
     if (ret != 0) {
         log_e("evbuffer_add failed");
+        evhttp_request_free(req);
+        failures_++;
         return false;
     }
 
+    // 失败时libevent会释放req
     ret = evhttp_make_request(conn, req, EVHTTP_REQ_POST, path.c_str());
     if (ret != 0) {
         log_e("evhttp_make_request failed");
+        conn_broken_ = true;
+        failures_++;
         return false;
     }
 
+    raw_bytes_ += data.length();
+    sent_bytes_ += body.length();
+
     event_base_dispatch(base_);
-    evhttp_connection_free(conn);
+    conn_used_ts_ = Utils::GetSteadyMilliSeconds();
+
+    if (!ctx.ok) {
+        failures_++;
+    }
+    return ctx.ok;
+}
+
+void HttpClient::GetStats(uint64_t& requests,
+                          uint64_t& failures,
+                          uint64_t& raw_bytes,
+                          uint64_t& sent_bytes)
+{
+    requests   = requests_;
+    failures   = failures_;
+    raw_bytes  = raw_bytes_;
+    sent_bytes = sent_bytes_;
+}
+
+bool HttpClient::compress(const std::string& in,
+                          std::string&       out,
+                          std::string&       encoding)
+{
+    const std::string& algorithm = Config::Instance()->elk_upload_compression;
+    if (algorithm != "gzip" && algorithm != "deflate") {
+        return false;
+    }
+    if (in.size() < static_cast<size_t>(
+                        Config::Instance()->elk_upload_compress_min_bytes)) {
+        return false;
+    }
 
-    return ok_;
+    // windowBits加16输出gzip格式，否则为zlib格式(HTTP的deflate)
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    int window_bits = algorithm == "gzip" ? MAX_WBITS + 16 : MAX_WBITS;
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        log_e("deflateInit2 failed");
+        return false;
+    }
+
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in  = static_cast<uInt>(in.size());
+    zs.next_out  = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+
+    int ret = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        log_e("deflate failed. ret={}", ret);
+        return false;
+    }
+
+    out.resize(zs.total_out);
+    encoding = algorithm;
+    return true;
+}
+
+evhttp_connection* HttpClient::get_connection(const std::string& host, int port)
+{
+    // 空闲太久的连接可能已被服务器关闭，直接重建，避免请求失败后再重试
+    int64_t now = Utils::GetSteadyMilliSeconds();
+    if (conn_ &&
+        (conn_broken_ || now - conn_used_ts_ >
+                             Config::Instance()->elk_http_keep_alive_idle_ms)) {
+        free_connection();
+    }
+
+    if (conn_) {
+        return conn_;
+    }
+
+    // 优先使用缓存的解析结果，避免每次建连都同步解析域名
+    std::string              address   = host;
+    std::vector<std::string> addresses = DnsCache::Instance()->Lookup(host);
+    if (!addresses.empty()) {
+        const std::string& first = addresses[0];
+        address = first[0] == '[' ? first.substr(1, first.size() - 2) : first;
+    }
+
+    evhttp_connection* conn =
+        evhttp_connection_base_new(base_, nullptr, address.c_str(), port);
+    if (!conn) {
+        log_e("evhttp_connection_base_new failed");
+        return nullptr;
+    }
+
+    evhttp_connection_set_retries(conn, 1);
+    evhttp_connection_set_timeout(conn, 1);
+
+    conn_        = conn;
+    conn_broken_ = false;
+    return conn;
+}
+
+void HttpClient::free_connection()
+{
+    if (conn_) {
+        evhttp_connection_free(conn_);
+        conn_ = nullptr;
+    }
 }
 
 void HttpClient::Initialize()
@@ -109,6 +250,7 @@ void HttpClient::Close()
     if (!init_)
         return;
 
+    free_connection();
     event_base_free(base_);
     init_ = false;
 }
@@ -1,15 +1,32 @@
 #ifndef EDU_PUSH_SDK_HTTP_CLIENT_H
 #define EDU_PUSH_SDK_HTTP_CLIENT_H
 
+#include <atomic>
 #include <map>
 #include <mutex>
 #include <string>
 
 struct event_base;
+struct evhttp_connection;
 struct evhttp_request;
 
 namespace edu {
+
+// 使用持久连接的HTTP客户端，连接在多次请求之间复用，空闲超时或请求失败后重建
 class HttpClient {
+  public:
+    struct RequestContext
+    {
+        RequestContext()
+        {
+            client = nullptr;
+            ok     = false;
+        }
+
+        HttpClient* client;
+        bool        ok;
+    };
+
   public:
     HttpClient();
 
@@ -20,19 +37,45 @@ class HttpClient {
 
     void Close();
 
-    void HandleRequestCallBack(struct evhttp_request* req);
+    void HandleRequestCallBack(RequestContext* ctx, struct evhttp_request* req);
+
+    bool Post(const std::string                         host,
+              int                                       port,
+              const std::string&                        path,
+              const std::map<std::string, std::string>& headers,
+              const std::string&                        data);
 
-    bool Post(const std::string                         ip,
-             int                                       port,
-             const std::string&                        path,
-             const std::map<std::string, std::string>& headers,
-             const std::string&                        data);
+    // 累计的请求数、失败数、压缩前字节数、实际发送字节数
+    void GetStats(uint64_t& requests,
+                  uint64_t& failures,
+                  uint64_t& raw_bytes,
+                  uint64_t& sent_bytes);
+
+  private:
+    evhttp_connection* get_connection(const std::string& host, int port);
+    void               free_connection();
+
+    // 按配置压缩请求内容，不压缩时返回false
+    static bool compress(const std::string& in,
+                         std::string&       out,
+                         std::string&       encoding);
 
   private:
     std::mutex  mux_;
     event_base* base_;
-    bool        ok_;
     bool        init_;
+
+    evhttp_connection* conn_;
+    // 请求失败的连接在下次使用前重建
+    bool        conn_broken_;
+    int64_t     conn_used_ts_;
+    std::string conn_host_;
+    int         conn_port_;
+
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> failures_;
+    std::atomic<uint64_t> raw_bytes_;
+    std::atomic<uint64_t> sent_bytes_;
 };
 }  // namespace edu
 
@@ -0,0 +1,87 @@
+#ifndef EDU_PUSH_SDK_MPSC_RING_H
+#define EDU_PUSH_SDK_MPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace edu {
+
+// 固定容量的多生产者单消费者环形队列，槽位预先分配，入队出队都不加锁、不分配内存。
+// 每个槽位带序号，生产者通过CAS抢占写入位置，写完后更新序号交给消费者。
+// Push可在任意线程调用，Pop、Clear只能在同一时刻的单个消费者线程调用
+template <typename T, size_t N> class MpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+  public:
+    MpscRing()
+    {
+        for (size_t i = 0; i < N; i++) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        tail_.store(0, std::memory_order_relaxed);
+        head_ = 0;
+    }
+
+  public:
+    // 抢占一个空闲槽位并调用fill(T&)填充，队列满时返回false
+    template <typename F> bool Push(F fill)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot&    slot = slots_[pos & (N - 1)];
+            size_t   seq  = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed)) {
+                    fill(slot.data);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 取出最早的元素，队列为空或该槽位尚未写完时返回false
+    bool Pop(T& data)
+    {
+        Slot&  slot = slots_[head_ & (N - 1)];
+        size_t seq  = slot.seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq - (head_ + 1)) < 0) {
+            return false;
+        }
+
+        data = slot.data;
+        slot.seq.store(head_ + N, std::memory_order_release);
+        head_++;
+        return true;
+    }
+
+    void Clear()
+    {
+        T data;
+        while (Pop(data)) {}
+    }
+
+  private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+
+    Slot                slots_[N];
+    std::atomic<size_t> tail_;
+    size_t              head_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
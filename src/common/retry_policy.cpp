@@ -0,0 +1,76 @@
+#include <common/retry_policy.h>
+#include <common/utils.h>
+
+#include <algorithm>
+
+namespace edu {
+
+RetryPolicy::RetryPolicy(int    base_ms,
+                         int    cap_ms,
+                         double multiplier,
+                         int    budget)
+{
+    std::random_device rd;
+    rng_.seed(rd() ^ static_cast<uint32_t>(Utils::GetSteadyNanoSeconds()));
+
+    base_ms_       = std::max(1, base_ms);
+    cap_ms_        = std::max(base_ms_, cap_ms);
+    multiplier_    = std::max(1.0, multiplier);
+    budget_        = budget;
+    attempts_      = 0;
+    budget_used_   = 0;
+    total_retries_ = 0;
+}
+
+RetryPolicy::~RetryPolicy() {}
+
+int64_t RetryPolicy::NextBackoffMs()
+{
+    std::unique_lock<std::mutex> lock(mux_);
+
+    if (budget_ > 0 && budget_used_ >= budget_) {
+        return -1;
+    }
+
+    double upper = base_ms_;
+    for (uint32_t i = 0; i < attempts_ && upper < cap_ms_; i++) {
+        upper *= multiplier_;
+    }
+    upper = std::min(upper, static_cast<double>(cap_ms_));
+
+    std::uniform_int_distribution<int64_t> dist(0,
+                                                static_cast<int64_t>(upper));
+
+    attempts_++;
+    budget_used_++;
+    total_retries_++;
+
+    return dist(rng_);
+}
+
+void RetryPolicy::Reset()
+{
+    std::unique_lock<std::mutex> lock(mux_);
+    attempts_ = 0;
+}
+
+void RetryPolicy::ResetBudget()
+{
+    std::unique_lock<std::mutex> lock(mux_);
+    attempts_    = 0;
+    budget_used_ = 0;
+}
+
+uint32_t RetryPolicy::Attempts()
+{
+    std::unique_lock<std::mutex> lock(mux_);
+    return attempts_;
+}
+
+uint64_t RetryPolicy::TotalRetries()
+{
+    std::unique_lock<std::mutex> lock(mux_);
+    return total_retries_;
+}
+
+}  // namespace edu
\ No newline at end of file
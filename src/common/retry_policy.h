@@ -0,0 +1,43 @@
+#ifndef EDU_PUSH_SDK_RETRY_POLICY_H
+#define EDU_PUSH_SDK_RETRY_POLICY_H
+
+#include <mutex>
+#include <random>
+
+namespace edu {
+
+// 指数退避 + full jitter 重试策略，线程安全
+// 第n次重试等待 random(0, min(cap, base * multiplier^n)) ms
+class RetryPolicy {
+  public:
+    // budget 为一个会话内允许的最大重试次数，0为不限制
+    RetryPolicy(int base_ms, int cap_ms, double multiplier, int budget = 0);
+    ~RetryPolicy();
+
+  public:
+    // 计算下次重试前需要等待的时长(ms)，预算耗尽返回-1
+    int64_t NextBackoffMs();
+    // 重试成功后调用，退避时长从base重新开始
+    void Reset();
+    // 开始新的会话时调用，恢复重试预算
+    void ResetBudget();
+
+    uint32_t Attempts();
+    uint64_t TotalRetries();
+
+  private:
+    std::mutex mux_;
+    // 每个会话都有重试策略，jitter不需要mt19937的质量，用状态更小的引擎
+    std::minstd_rand rng_;
+    int              base_ms_;
+    int              cap_ms_;
+    double           multiplier_;
+    int              budget_;
+    uint32_t         attempts_;
+    int              budget_used_;
+    uint64_t         total_retries_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
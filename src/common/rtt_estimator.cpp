@@ -0,0 +1,56 @@
+#include <common/rtt_estimator.h>
+
+namespace edu {
+
+RttEstimator::RttEstimator()
+{
+    ewma_    = 0;
+    min_     = 0;
+    max_     = 0;
+    samples_ = 0;
+}
+
+void RttEstimator::Update(int64_t rtt_us, double alpha)
+{
+    if (rtt_us < 0) {
+        return;
+    }
+
+    if (samples_ == 0) {
+        ewma_ = rtt_us;
+        min_  = rtt_us;
+        max_  = rtt_us;
+    }
+    else {
+        ewma_ += alpha * (rtt_us - ewma_);
+        if (rtt_us < min_) {
+            min_ = rtt_us;
+        }
+        if (rtt_us > max_) {
+            max_ = rtt_us;
+        }
+    }
+    samples_++;
+}
+
+int64_t RttEstimator::Ewma() const
+{
+    return static_cast<int64_t>(ewma_);
+}
+
+int64_t RttEstimator::Min() const
+{
+    return min_;
+}
+
+int64_t RttEstimator::Max() const
+{
+    return max_;
+}
+
+uint64_t RttEstimator::Samples() const
+{
+    return samples_;
+}
+
+}  // namespace edu
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef EDU_PUSH_SDK_RTT_ESTIMATOR_H
+#define EDU_PUSH_SDK_RTT_ESTIMATOR_H
+
+#include <stdint.h>
+
+namespace edu {
+
+// RTT估计(us)，EWMA平滑，同时记录最小、最大值，非线程安全
+class RttEstimator {
+  public:
+    RttEstimator();
+
+  public:
+    void Update(int64_t rtt_us, double alpha);
+
+    int64_t  Ewma() const;
+    int64_t  Min() const;
+    int64_t  Max() const;
+    uint64_t Samples() const;
+
+  private:
+    double   ewma_;
+    int64_t  min_;
+    int64_t  max_;
+    uint64_t samples_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
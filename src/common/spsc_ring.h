@@ -0,0 +1,64 @@
+#ifndef EDU_PUSH_SDK_SPSC_RING_H
+#define EDU_PUSH_SDK_SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace edu {
+
+// 固定容量的单生产者单消费者环形队列，槽位预先分配，入队出队都不加锁、不分配内存。
+// 读写位置只由各自一方修改，分开放在不同的缓存行上避免伪共享。
+// Push只能在同一个生产者线程调用，Consume只能在同一时刻的单个消费者线程调用
+template <typename T, size_t N> class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+  public:
+    SpscRing()
+    {
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+  public:
+    // 调用fill(T&)填充下一个槽位，队列满时返回false
+    template <typename F> bool Push(F fill)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+
+        fill(slots_[tail & (N - 1)]);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 对当前所有元素依次调用consume(const T&)，之后一次性释放槽位，返回元素个数
+    template <typename F> size_t Consume(F consume)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        for (size_t pos = head; pos != tail; pos++) {
+            consume(static_cast<const T&>(slots_[pos & (N - 1)]));
+        }
+
+        head_.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+    bool Empty()
+    {
+        return head_.load(std::memory_order_acquire) ==
+               tail_.load(std::memory_order_acquire);
+    }
+
+  private:
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+    alignas(64) T slots_[N];
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include <common/text_pool.h>
+
+#include <cstring>
+
+namespace edu {
+
+TextPool::TextPool()
+{
+    free_.reserve(TEXT_POOL_SIZE);
+    for (int i = TEXT_POOL_SIZE - 1; i >= 0; i--) {
+        free_.push_back(i);
+    }
+}
+
+int TextPool::Put(const char* text, size_t len)
+{
+    int id = -1;
+    {
+        std::unique_lock<std::mutex> lock(mux_);
+        if (free_.empty()) {
+            return -1;
+        }
+        id = free_.back();
+        free_.pop_back();
+    }
+
+    // 取出的缓冲只有当前线程使用，拷贝不需要加锁
+    len = len < TEXT_POOL_TEXT_LEN - 1 ? len : TEXT_POOL_TEXT_LEN - 1;
+    memcpy(texts_[id], text, len);
+    texts_[id][len] = '\0';
+    return id;
+}
+
+const char* TextPool::Get(int id)
+{
+    return texts_[id];
+}
+
+void TextPool::Release(int id)
+{
+    std::unique_lock<std::mutex> lock(mux_);
+    free_.push_back(id);
+}
+
+}  // namespace edu
\ No newline at end of file
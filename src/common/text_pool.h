@@ -0,0 +1,41 @@
+#ifndef EDU_PUSH_SDK_TEXT_POOL_H
+#define EDU_PUSH_SDK_TEXT_POOL_H
+
+#include <common/singleton.h>
+
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+#define TEXT_POOL_SIZE 64
+#define TEXT_POOL_TEXT_LEN 256
+
+namespace edu {
+
+// 所有会话共用的定长文本缓冲池，用于暂存事件的长描述(如服务器返回的错误信息)，
+// 事件槽位中只保存编号。缓冲预先分配，超长截断，线程安全
+class TextPool : public Singleton<TextPool> {
+    friend class Singleton<TextPool>;
+
+  public:
+    virtual ~TextPool() {}
+
+  protected:
+    TextPool();
+
+  public:
+    // 拷贝text到空闲缓冲，返回编号，没有空闲缓冲时返回-1
+    int Put(const char* text, size_t len);
+    // 编号必须来自Put且尚未Release
+    const char* Get(int id);
+    void        Release(int id);
+
+  private:
+    char             texts_[TEXT_POOL_SIZE][TEXT_POOL_TEXT_LEN];
+    std::vector<int> free_;
+    std::mutex       mux_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
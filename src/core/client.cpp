@@ -1,38 +1,95 @@
 #include <common/config.h>
+#include <common/dns_cache.h>
 #include <common/log.h>
 #include <common/utils.h>
 #include <core/client.h>
+#include <core/packet.h>
 #include <push_sdk.h>
 
 #include <grpcpp/create_channel.h>
 #include <grpcpp/security/credentials.h>
+#include <zlib.h>
 
+#include <algorithm>
+#include <random>
 #include <sstream>
 
 #include <core/stream.h>
 
 namespace edu {
 
-std::atomic<uint32_t> Client::port_index_(0);
+// 区分连接池中通道的自定义参数
+#define PS_ARG_CHANNEL_ID "push_sdk.channel_id"
 
-Client::Client()
+// HTTP/2流控预设，-1表示使用GRPC默认值
+struct FlowControlPreset
+{
+    const char* name;
+    int         bdp_probe;
+    int         stream_lookahead_bytes;
+    int         write_buffer_size;
+    int         max_receive_message_length;
+};
+
+// 实验性预设，数值为估计值，未经实测验证
+static const FlowControlPreset flow_control_presets[] = {
+    // 高延迟移动网络：放大初始窗口，扇出突发时不必等待WINDOW_UPDATE
+    {"mobile", 1, 1024 * 1024, 256 * 1024, 8 * 1024 * 1024},
+    // 低延迟大带宽：初始窗口足够大，之后交给BDP探测增长
+    {"datacenter", 1, 4 * 1024 * 1024, 1024 * 1024, 32 * 1024 * 1024},
+    // 内存受限：关闭BDP探测，固定小窗口
+    {"low-memory", 0, 64 * 1024, 16 * 1024, 1024 * 1024},
+};
+
+std::atomic<uint32_t>               Client::preferred_endpoint_(0);
+uint32_t Client::spread_seed_ = std::random_device()();
+std::map<std::string, RttEstimator> Client::rtts_;
+std::mutex                          Client::rtts_mux_;
+
+Client::Client(int channel_id)
 {
     cq      = std::unique_ptr<grpc::CompletionQueue>(new grpc::CompletionQueue);
     stub    = nullptr;
     channel = nullptr;
 
-    st_                 = nullptr;
     init_               = false;
     thread_             = nullptr;
     run_                = false;
     going_to_quit_      = false;
-    channel_state_lis_  = nullptr;
-    msg_hdl_            = nullptr;
-    stream_status_lis_  = nullptr;
     last_channel_state_ = ChannelState::UNKNOW;
-    last_heartbeat_ts_  = 0;
-    uid_                = 0;
-    suid_               = 0;
+    maintain_ts_        = 0;
+    quit_deadline_      = 0;
+    next_slot_          = 1;
+    channel_id_         = channel_id;
+    msgs_sent_          = 0;
+    bytes_sent_         = 0;
+    msgs_recv_          = 0;
+    bytes_recv_         = 0;
+
+    compression_algorithm_ = get_compression_algorithm();
+    compressed_msgs_       = 0;
+    compress_raw_bytes_    = 0;
+    compress_sample_raw_   = 0;
+    compress_sample_zip_   = 0;
+
+    pending_channel_state_    = ChannelState::UNKNOW;
+    pending_channel_state_ts_ = 0;
+    channel_state_watching_   = false;
+    channel_state_watch_seq_  = 0;
+
+    reconnect_policy_   = std::unique_ptr<RetryPolicy>(
+        new RetryPolicy(Config::Instance()->retry_backoff_base_ms,
+                        Config::Instance()->retry_backoff_cap_ms,
+                        Config::Instance()->retry_backoff_multiplier));
+    reconnect_ts_       = 0;
+    endpoint_ts_        = 0;
+    standby_channel_    = nullptr;
+    standby_check_ts_   = 0;
+    standby_failovers_  = 0;
+    connector_          = std::unique_ptr<Connector>(
+        new Connector(cq.get(), [this](const std::string& address) {
+            return create_channel(address);
+        }));
 }
 
 Client ::~Client()
@@ -40,43 +97,158 @@ Client ::~Client()
     Destroy();
 }
 
-void Client::SetChannelStateListener(
-    std::shared_ptr<ChannelStateListener> listener)
+std::shared_ptr<ClientSession>
+Client::AddSession(uint32_t                              uid,
+                   uint64_t                              suid,
+                   std::shared_ptr<ChannelStateListener> channel_state_lis,
+                   std::shared_ptr<StreamStatusListener> stream_status_lis,
+                   std::shared_ptr<MessageHandler>       msg_hdl)
+{
+    std::shared_ptr<ClientSession> session = std::make_shared<ClientSession>();
+    session->uid                           = uid;
+    session->suid                          = suid;
+    session->channel_state_lis             = channel_state_lis;
+    session->stream_status_lis             = stream_status_lis;
+    session->msg_hdl                       = msg_hdl;
+    session->restart_policy                = std::unique_ptr<RetryPolicy>(
+        new RetryPolicy(Config::Instance()->retry_backoff_base_ms,
+                        Config::Instance()->retry_backoff_cap_ms,
+                        Config::Instance()->retry_backoff_multiplier));
+
+    std::unique_lock<std::mutex> lock(stream_mux_);
+    // tag中会话序号只有24位，回绕后跳过0及仍在使用的序号
+    do {
+        session->slot = next_slot_++ & 0xffffff;
+    } while (session->slot == 0 ||
+             sessions_.find(session->slot) != sessions_.end());
+    sessions_[session->slot] = session;
+
+    return session;
+}
+
+void Client::RemoveSession(std::shared_ptr<ClientSession> session)
+{
+    std::unique_lock<std::mutex> lock(stream_mux_);
+
+    auto it = sessions_.find(session->slot);
+    if (it == sessions_.end() || it->second != session) {
+        return;
+    }
+
+    session->closing = true;
+    if (!session->st) {
+        sessions_.erase(it);
+        return;
+    }
+
+    // 由CQ线程半关闭stream，收到FINISHED后移除。服务器一直不结束stream时
+    // 取消该stream，取消后未完成的操作会立即以失败返回
+    auto removed = [this, &session]() {
+        auto it = sessions_.find(session->slot);
+        return it == sessions_.end() || it->second != session;
+    };
+    std::chrono::milliseconds timeout(
+        Config::Instance()->grpc_session_close_timeout_ms);
+    if (stream_cond_.wait_for(lock, timeout, removed)) {
+        return;
+    }
+
+    log_w("stream close timeout, cancel it. uid={}", session->uid);
+    if (session->st) {
+        session->st->Cancel();
+    }
+    if (!stream_cond_.wait_for(lock, timeout, removed)) {
+        log_e("stream cancel timeout. uid={}", session->uid);
+    }
+}
+
+void Client::Send(std::shared_ptr<ClientSession> session,
+                  std::shared_ptr<PushRegReq>    req)
 {
-    channel_state_lis_ = listener;
+    session->msg_queue_mux.lock();
+    session->msg_queue.emplace_back(req);
+    session->msg_queue_mux.unlock();
 }
 
-void Client::SetClientStatusListener(
-    std::shared_ptr<StreamStatusListener> listener)
+void Client::CleanQueue(std::shared_ptr<ClientSession> session)
 {
-    stream_status_lis_ = listener;
+    session->msg_queue_mux.lock();
+    session->msg_queue.clear();
+    session->msg_queue_mux.unlock();
 }
 
-void Client::SetMessageHandler(std::shared_ptr<MessageHandler> hdl)
+size_t Client::GetSessionCount()
 {
-    msg_hdl_ = hdl;
+    std::unique_lock<std::mutex> lock(stream_mux_);
+    return sessions_.size();
 }
 
-void Client::CleanQueue()
+void Client::GetTraffic(uint64_t& msgs_sent,
+                        uint64_t& bytes_sent,
+                        uint64_t& msgs_recv,
+                        uint64_t& bytes_recv)
 {
-    msg_queue_mux_.lock();
-    msg_queue_.clear();
-    msg_queue_mux_.unlock();
+    msgs_sent  = msgs_sent_;
+    bytes_sent = bytes_sent_;
+    msgs_recv  = msgs_recv_;
+    bytes_recv = bytes_recv_;
 }
 
-uint32_t Client::GetUID()
+uint64_t Client::GetReconnectRetries()
 {
-    return uid_;
+    return reconnect_policy_->TotalRetries();
 }
 
-uint64_t Client::GetSUID()
+uint64_t Client::GetStandbyFailovers()
 {
-    return suid_;
+    return standby_failovers_;
+}
+
+void Client::GetCompression(uint64_t& compressed_msgs,
+                            uint64_t& raw_bytes,
+                            uint64_t& zip_bytes)
+{
+    std::unique_lock<std::mutex> lock(compress_mux_);
+
+    // 在调用者线程上压缩最近一条抽样消息，累计抽样压缩率
+    if (compress_sample_) {
+        std::string raw  = compress_sample_->SerializeAsString();
+        uLongf      zlen = compressBound(raw.size());
+        std::string zip(zlen, '\0');
+        compress_sample_ = nullptr;
+        if (compress2(reinterpret_cast<Bytef*>(&zip[0]), &zlen,
+                      reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+                      Z_DEFAULT_COMPRESSION) == Z_OK) {
+            compress_sample_raw_ += raw.size();
+            compress_sample_zip_ += zlen;
+        }
+    }
+
+    compressed_msgs = compressed_msgs_;
+    raw_bytes       = compress_raw_bytes_;
+    zip_bytes       = 0;
+    if (compress_sample_raw_ > 0) {
+        zip_bytes = static_cast<uint64_t>(
+            static_cast<double>(raw_bytes) * compress_sample_zip_ /
+            compress_sample_raw_);
+    }
+}
+
+void Client::GetRtt(std::string& endpoint, RttEstimator& rtt)
+{
+    std::unique_lock<std::mutex> lock(rtts_mux_);
+    endpoint = endpoint_;
+    auto it  = rtts_.find(endpoint_);
+    if (it != rtts_.end()) {
+        rtt = it->second;
+    }
 }
 
-static grpc::ChannelArguments get_channel_args()
+grpc::ChannelArguments Client::get_channel_args(int channel_id)
 {
     grpc::ChannelArguments args;
+    // 参数不同的通道不会共用subchannel，连接池中每个通道建立独立的HTTP/2连接
+    args.SetInt(PS_ARG_CHANNEL_ID, channel_id);
     // GRPC心跳间隔(ms)
     args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS,
                 Config::Instance()->grpc_keep_alive_time);
@@ -92,107 +264,615 @@ static grpc::ChannelArguments get_channel_args()
     // GRPC发送连续的ping帧而不接收任何数据之间的最短时间(ms)
     args.SetInt(GRPC_ARG_HTTP2_MIN_SENT_PING_INTERVAL_WITHOUT_DATA_MS,
                 Config::Instance()->grpc_min_sent_ping_interval_without_data);
+    // GRPC通道默认压缩算法，小消息在写入时单独关闭压缩
+    args.SetCompressionAlgorithm(get_compression_algorithm());
+    // GRPC HTTP/2流控
+    set_flow_control_args(args);
+    // GRPC 负载均衡策略
+    const std::string& lb_policy = Config::Instance()->grpc_lb_policy;
+    if (!lb_policy.empty()) {
+        args.SetServiceConfigJSON("{\"loadBalancingConfig\":[{\"" +
+                                  lb_policy + "\":{}}]}");
+    }
 
     return args;
 }
 
-void Client::create_channel_and_stub(bool need_to_change_port)
+void Client::set_flow_control_args(grpc::ChannelArguments& args)
 {
-    if (need_to_change_port) {
-        port_index_++;
+    FlowControlPreset  preset = {"", -1, -1, -1, -1};
+    const std::string& name   = Config::Instance()->grpc_flow_control_preset;
+    if (!name.empty()) {
+        bool found = false;
+        for (const FlowControlPreset& p : flow_control_presets) {
+            if (name == p.name) {
+                preset = p;
+                found  = true;
+                log_w("experimental flow control preset {} enabled", name);
+                break;
+            }
+        }
+        if (!found) {
+            log_w("unknown flow control preset {}", name);
+        }
     }
 
-    std::ostringstream oss;
-    oss << Config::Instance()->front_envoy_host << ":"
-        << Config::Instance()->front_envoy_ports
-               [port_index_ % Config::Instance()->front_envoy_ports.size()];
+    // 单独配置的参数优先于预设
+    std::shared_ptr<Config> conf = Config::Instance();
+    if (conf->grpc_http2_bdp_probe >= 0) {
+        preset.bdp_probe = conf->grpc_http2_bdp_probe;
+    }
+    if (conf->grpc_http2_stream_lookahead_bytes >= 0) {
+        preset.stream_lookahead_bytes = conf->grpc_http2_stream_lookahead_bytes;
+    }
+    if (conf->grpc_http2_write_buffer_size >= 0) {
+        preset.write_buffer_size = conf->grpc_http2_write_buffer_size;
+    }
+    if (conf->grpc_max_receive_message_length >= 0) {
+        preset.max_receive_message_length =
+            conf->grpc_max_receive_message_length;
+    }
 
-    log_t("using address {}", oss.str());
+    if (preset.bdp_probe >= 0) {
+        args.SetInt(GRPC_ARG_HTTP2_BDP_PROBE, preset.bdp_probe);
+    }
+    if (preset.stream_lookahead_bytes >= 0) {
+        args.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+                    preset.stream_lookahead_bytes);
+    }
+    if (preset.write_buffer_size >= 0) {
+        args.SetInt(GRPC_ARG_HTTP2_WRITE_BUFFER_SIZE, preset.write_buffer_size);
+    }
+    if (preset.max_receive_message_length >= 0) {
+        args.SetMaxReceiveMessageSize(preset.max_receive_message_length);
+    }
+}
+
+grpc_compression_algorithm Client::get_compression_algorithm()
+{
+    const std::string& name = Config::Instance()->grpc_compression_algorithm;
+    if (name == "gzip") {
+        return GRPC_COMPRESS_GZIP;
+    }
+    if (name == "deflate") {
+        return GRPC_COMPRESS_DEFLATE;
+    }
+    if (name != "none") {
+        log_w("unknown compression algorithm {}, disabled", name);
+    }
+    return GRPC_COMPRESS_NONE;
+}
 
-    channel = grpc::CreateCustomChannel(
-        oss.str(), grpc::InsecureChannelCredentials(), get_channel_args());
+static bool is_unix_address(const std::string& address)
+{
+    return address.compare(0, 5, "unix:") == 0;
+}
 
-    assert(channel);
+std::vector<std::string>
+Client::get_endpoints(std::map<std::string, std::string>* authorities)
+{
+    std::vector<std::string> endpoints;
+#ifndef _WIN32
+    for (const std::string& uds : Config::Instance()->grpc_uds_endpoints) {
+        endpoints.push_back(is_unix_address(uds) ? uds : "unix:" + uds);
+    }
+#endif
 
-    channel->WaitForConnected(
-        std::chrono::system_clock::now() +
-        std::chrono::milliseconds(Config::Instance()->grpc_wait_connect_ms));
+    std::vector<std::string> hosts = {Config::Instance()->front_envoy_host};
+    for (const std::string& host : Config::Instance()->front_envoy_hosts) {
+        if (std::find(hosts.begin(), hosts.end(), host) == hosts.end()) {
+            hosts.push_back(host);
+        }
+    }
 
-    stub = PushGateway::NewStub(channel);
+    // 只使用缓存的解析结果，尚未解析出地址的域名交给GRPC自己解析
+    std::vector<std::vector<std::string>> resolved;
+    for (const std::string& host : hosts) {
+        std::vector<std::string> addresses = DnsCache::Instance()->Lookup(host);
+        // 每个进程从不同的地址开始，客户端分散到各个网关
+        if (!addresses.empty()) {
+            std::rotate(addresses.begin(),
+                        addresses.begin() + spread_seed_ % addresses.size(),
+                        addresses.end());
+        }
+        resolved.push_back(addresses);
+    }
 
-    assert(stub);
+    bool round_robin = Config::Instance()->grpc_lb_policy == "round_robin";
+    for (int port : Config::Instance()->front_envoy_ports) {
+        std::string suffix = ":" + std::to_string(port);
+        std::string ipv4, ipv6, ipv4_authority, ipv6_authority;
+        for (size_t i = 0; i < hosts.size(); i++) {
+            if (resolved[i].empty()) {
+                endpoints.push_back(hosts[i] + suffix);
+                continue;
+            }
+            for (const std::string& address : resolved[i]) {
+                if (!round_robin) {
+                    endpoints.push_back(address + suffix);
+                    if (authorities) {
+                        (*authorities)[endpoints.back()] = hosts[i] + suffix;
+                    }
+                    continue;
+                }
+                // 同一端口的所有地址组成一个通道，由round_robin分散stream
+                bool         v6        = address[0] == '[';
+                std::string& list      = v6 ? ipv6 : ipv4;
+                std::string& authority = v6 ? ipv6_authority : ipv4_authority;
+                list += (list.empty() ? "" : ",") + address + suffix;
+                // 混合多个域名时使用第一个域名作为:authority
+                if (authority.empty()) {
+                    authority = hosts[i] + suffix;
+                }
+            }
+        }
+        if (!ipv4.empty()) {
+            endpoints.push_back("ipv4:" + ipv4);
+            if (authorities) {
+                (*authorities)[endpoints.back()] = ipv4_authority;
+            }
+        }
+        if (!ipv6.empty()) {
+            endpoints.push_back("ipv6:" + ipv6);
+            if (authorities) {
+                (*authorities)[endpoints.back()] = ipv6_authority;
+            }
+        }
+    }
+    return endpoints;
 }
 
-void Client::create_and_init_stream()
+void Client::start_connect()
 {
-    stream_mux_.lock();
-    assert(stub);
-    st_ = std::unique_ptr<Stream>(new Stream(shared_from_this()));
-    assert(st_);
-    st_->Init();
-    stream_mux_.unlock();
+    // 通道已就绪直接使用，否则发起连接竞速，不阻塞事件循环
+    if (channel && channel->GetState(true) == GRPC_CHANNEL_READY) {
+        maintain_ts_ = 0;
+        return;
+    }
+
+    // 上次胜出的地址优先，其余按顺序排在后面
+    authorities_.clear();
+    std::vector<std::string> endpoints = get_endpoints(&authorities_);
+    std::vector<std::string> addresses;
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        addresses.push_back(
+            endpoints[(preferred_endpoint_ + i) % endpoints.size()]);
+    }
+
+    // 有RTT数据的地址按RTT从小到大排在最前面
+    std::map<std::string, int64_t> rtts;
+    rtts_mux_.lock();
+    for (auto& it : rtts_) {
+        if (it.second.Samples() > 0) {
+            rtts[it.first] = it.second.Ewma();
+        }
+    }
+    rtts_mux_.unlock();
+
+    std::stable_sort(addresses.begin(), addresses.end(),
+                     [&rtts](const std::string& a, const std::string& b) {
+                         auto ia = rtts.find(a);
+                         auto ib = rtts.find(b);
+                         if (ia == rtts.end() || ib == rtts.end()) {
+                             return ia != rtts.end() && ib == rtts.end();
+                         }
+                         return ia->second < ib->second;
+                     });
+
+    // 本机sidecar没有网络开销，可用时总是优先于TCP地址
+    std::stable_partition(addresses.begin(), addresses.end(), is_unix_address);
+
+    race_addresses_ = addresses;
+    connector_->Start(addresses);
 }
 
-void Client::check_and_notify_channel_state()
+std::shared_ptr<grpc::Channel>
+Client::create_channel(const std::string& address)
+{
+    grpc::ChannelArguments args = get_channel_args(channel_id_);
+    // 直接连接IP时GRPC默认把IP作为:authority，网关按域名路由及校验会失败
+    auto it = authorities_.find(address);
+    if (it != authorities_.end()) {
+        args.SetString(GRPC_ARG_DEFAULT_AUTHORITY, it->second);
+    }
+    return grpc::CreateCustomChannel(
+        address, grpc::InsecureChannelCredentials(), args);
+}
+
+void Client::check_connect_race()
+{
+    std::shared_ptr<grpc::Channel> winner = connector_->Poll();
+    if (winner) {
+        // 记住胜出的地址，下次重连优先使用
+        std::vector<std::string> endpoints = get_endpoints();
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            if (endpoints[i] == connector_->WinnerAddress()) {
+                preferred_endpoint_ = i;
+                break;
+            }
+        }
+
+        rtts_mux_.lock();
+        endpoint_    = connector_->WinnerAddress();
+        endpoint_ts_ = Utils::GetSteadyNanoSeconds();
+        rtts_mux_.unlock();
+
+        channel                 = winner;
+        stub                    = PushGateway::NewStub(channel);
+        maintain_ts_            = 0;
+        channel_state_watching_ = false;
+        assert(stub);
+
+        if (standby_endpoint_ == endpoint_) {
+            standby_channel_  = nullptr;
+            standby_endpoint_ = "";
+        }
+
+        update_channel_state();
+    }
+    else if (connector_->IsFailed()) {
+        schedule_reconnect();
+    }
+}
+
+bool Client::is_connection_usable()
+{
+    return channel && stub && !connector_->IsRacing() && reconnect_ts_ == 0;
+}
+
+void Client::maintain_sessions()
+{
+    int64_t now  = Utils::GetSteadyMilliSeconds();
+    maintain_ts_ = now + Config::Instance()->grpc_cq_timeout_ms;
+
+    // 退出时服务器一直不结束stream，超时后取消剩余的stream
+    if (going_to_quit_ && quit_deadline_ == 0) {
+        quit_deadline_ =
+            now + Config::Instance()->grpc_session_close_timeout_ms;
+    }
+
+    bool usable = is_connection_usable();
+    auto it     = sessions_.begin();
+    while (it != sessions_.end()) {
+        ClientSession* session = it->second.get();
+        if (session->st) {
+            if (session->closing || going_to_quit_) {
+                // 有未完成的写操作时不会半关闭，下次再试
+                session->st->HalfClose();
+                if (going_to_quit_ && now >= quit_deadline_) {
+                    session->st->Cancel();
+                }
+            }
+            else if (session->st->IsReadyToSend()) {
+                send_all_msgs(session);
+            }
+        }
+        else if (session->closing || going_to_quit_) {
+            it = sessions_.erase(it);
+            stream_cond_.notify_all();
+            continue;
+        }
+        else if (usable && now >= session->restart_ts) {
+            session->st = std::unique_ptr<Stream>(
+                new Stream(shared_from_this(), session));
+            session->st->Init();
+        }
+        it++;
+    }
+
+    if (going_to_quit_ && sessions_.empty()) {
+        connector_->Stop();
+        run_ = false;
+    }
+}
+
+void Client::process_stream_event(ClientSession* session,
+                                  ClientEvent    event,
+                                  bool           ok)
+{
+    if (event == ClientEvent::FINISHED) {
+        on_stream_finished(session);
+        return;
+    }
+    else if (event == ClientEvent::HALF_CLOSE) {
+        session->st->Finish();
+        return;
+    }
+
+    if (!ok && session->st->IsConnected()) {
+        session->st->Finish();
+        return;
+    }
+
+    if (ok && !session->closing && !going_to_quit_ &&
+        session->st->IsReadyToSend()) {
+        send_all_msgs(session);
+    }
+
+    session->st->Process(event, ok);
+}
+
+void Client::on_stream_finished(ClientSession* session)
+{
+    session->st  = nullptr;
+    maintain_ts_ = 0;
+
+    if (session->closing || going_to_quit_) {
+        // 由maintain_sessions移除
+        return;
+    }
+
+    int64_t backoff     = session->restart_policy->NextBackoffMs();
+    session->restart_ts = Utils::GetSteadyMilliSeconds() + backoff;
+    log_w("stream finished. uid={}, restart after {}ms", session->uid,
+          backoff);
+
+    // 连接仍可用时只重建该stream，已断开时切换到热备连接或退避后重连
+    if (connector_->IsRacing() || reconnect_ts_ != 0 ||
+        (channel && channel->GetState(false) == GRPC_CHANNEL_READY)) {
+        return;
+    }
+    if (!failover_to_standby()) {
+        schedule_reconnect();
+    }
+}
+
+void Client::update_channel_state()
 {
-    assert(channel);
-    grpc_connectivity_state state = channel->GetState(false);
+    grpc_connectivity_state state =
+        channel ? channel->GetState(false) : GRPC_CHANNEL_IDLE;
 
     ChannelState new_state =
         state == GRPC_CHANNEL_READY ? ChannelState::OK : ChannelState::NO_READY;
 
-    if (new_state != last_channel_state_) {
-        last_channel_state_ = new_state;
+    if (new_state == last_channel_state_) {
+        // 在去抖窗口内恢复，不需要通知
+        pending_channel_state_ = ChannelState::UNKNOW;
+    }
+    else if (new_state != pending_channel_state_) {
+        pending_channel_state_    = new_state;
+        pending_channel_state_ts_ = Utils::GetSteadyMilliSeconds();
+    }
+
+    // 当前通道上只保留一个监听，只在状态变化或通道替换后重新监听，
+    // 旧通道上的监听返回时序号已过期，直接丢弃
+    if (channel && !channel_state_watching_) {
+        channel_state_watch_seq_ =
+            (channel_state_watch_seq_ + 1) & CLIENT_TAG_SEQ_MASK;
+        channel->NotifyOnStateChange(
+            state,
+            std::chrono::system_clock::now() +
+                std::chrono::milliseconds(
+                    Config::Instance()->grpc_wait_connect_ms),
+            cq.get(),
+            make_client_tag(channel_state_watch_seq_,
+                            ClientEvent::CHANNEL_STATE_CHANGED));
+        channel_state_watching_ = true;
+    }
+}
+
+void Client::check_and_notify_channel_state()
+{
+    if (pending_channel_state_ == ChannelState::UNKNOW ||
+        Utils::GetSteadyMilliSeconds() - pending_channel_state_ts_ <
+            Config::Instance()->channel_state_debounce_ms) {
+        return;
+    }
+
+    last_channel_state_    = pending_channel_state_;
+    pending_channel_state_ = ChannelState::UNKNOW;
+
+    // 不持有stream_mux_回调，回调中可能移除会话
+    std::vector<std::shared_ptr<ChannelStateListener>> listeners;
+    stream_mux_.lock();
+    for (auto& it : sessions_) {
+        if (it.second->channel_state_lis) {
+            listeners.push_back(it.second->channel_state_lis);
+        }
+    }
+    stream_mux_.unlock();
+
+    for (auto& listener : listeners) {
+        listener->NotifyChannelState(last_channel_state_);
+    }
+}
+void Client::maintain_standby()
+{
+    if (!Config::Instance()->grpc_standby_enable) {
+        return;
+    }
+
+    int64_t now = Utils::GetSteadyMilliSeconds();
+    if (now < standby_check_ts_) {
+        return;
+    }
+    standby_check_ts_ =
+        now + Config::Instance()->grpc_standby_check_interval_ms;
+
+    if (standby_channel_) {
+        grpc_connectivity_state state = standby_channel_->GetState(true);
+        if (state != GRPC_CHANNEL_TRANSIENT_FAILURE &&
+            state != GRPC_CHANNEL_SHUTDOWN) {
+            return;
+        }
+        log_w("standby channel to {} failed", standby_endpoint_);
+    }
+
+    // 选择竞速顺序中排在当前地址之后的下一个地址，失败时依次往后
+    std::vector<std::string> candidates;
+    for (const std::string& address : race_addresses_) {
+        if (address != endpoint_) {
+            candidates.push_back(address);
+        }
     }
-    else {
+    if (candidates.empty()) {
         return;
     }
 
-    if (channel_state_lis_) {
-        channel_state_lis_->NotifyChannelState(last_channel_state_);
+    size_t index = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (candidates[i] == standby_endpoint_) {
+            index = (i + 1) % candidates.size();
+            break;
+        }
     }
+
+    standby_endpoint_ = candidates[index];
+    standby_channel_  = create_channel(standby_endpoint_);
+    standby_channel_->GetState(true);
+    log_i("standby channel to {}", standby_endpoint_);
 }
-void Client::check_and_reconnect()
+
+bool Client::failover_to_standby()
 {
-    assert(channel);
-    grpc_connectivity_state state = channel->GetState(false);
-    if (state == GRPC_CHANNEL_SHUTDOWN ||
-        state == GRPC_CHANNEL_TRANSIENT_FAILURE) {
-        create_channel_and_stub(true);
+    if (!standby_channel_ ||
+        standby_channel_->GetState(false) != GRPC_CHANNEL_READY) {
+        return false;
     }
+
+    log_w("failover from {} to standby {}", endpoint_, standby_endpoint_);
+
+    rtts_mux_.lock();
+    endpoint_    = standby_endpoint_;
+    endpoint_ts_ = Utils::GetSteadyNanoSeconds();
+    rtts_mux_.unlock();
+
+    // 热备连接与主连接使用相同的通道参数，切换后直接作为主连接使用，
+    // 新的热备连接在下次检查时建立
+    channel                 = standby_channel_;
+    stub                    = PushGateway::NewStub(channel);
+    standby_channel_        = nullptr;
+    standby_check_ts_       = 0;
+    maintain_ts_            = 0;
+    channel_state_watching_ = false;
+    standby_failovers_++;
+
+    update_channel_state();
+    return true;
 }
 
-void Client::on_connected()
+void Client::schedule_reconnect()
 {
-    if (stream_status_lis_) {
-        stream_status_lis_->OnConnected();
+    // 重连不限制次数，只做退避，避免网关重启时所有客户端同时重连
+    int64_t backoff = reconnect_policy_->NextBackoffMs();
+    reconnect_ts_   = Utils::GetSteadyMilliSeconds() + backoff;
+    log_w("reconnect after {}ms. attempts={}", backoff,
+          reconnect_policy_->Attempts());
+}
+
+void Client::on_connected(ClientSession* session)
+{
+    reconnect_policy_->Reset();
+    session->restart_policy->Reset();
+
+    if (session->stream_status_lis) {
+        session->stream_status_lis->OnConnected();
     }
 }
 
-void Client::on_read(std::shared_ptr<PushData> push_data)
+void Client::on_read(ClientSession*            session,
+                     std::shared_ptr<PushData> push_data)
 {
-    if (msg_hdl_) {
-        msg_hdl_->OnMessage(push_data);
+    msgs_recv_++;
+    bytes_recv_ += push_data->ByteSizeLong();
+
+    if (push_data->uri() == StreamURI::PPushGateWayPongURI) {
+        on_pong(session, push_data);
+        return;
+    }
+
+    if (session->msg_hdl) {
+        session->msg_hdl->OnMessage(push_data);
     }
 }
 
-void Client::send_all_msgs()
+bool Client::on_write(std::shared_ptr<PushRegReq> req)
+{
+    if (compression_algorithm_ == GRPC_COMPRESS_NONE) {
+        return false;
+    }
+
+    size_t size = req->ByteSizeLong();
+    if (size < static_cast<size_t>(
+                   Config::Instance()->grpc_compression_min_bytes)) {
+        return false;
+    }
+
+    // GRPC不对外提供压缩后的大小，CQ线程上只统计原始大小并保留抽样消息，
+    // 压缩估算推迟到GetCompression的调用者线程
+    int      interval = Config::Instance()->grpc_compression_sample_interval;
+    uint64_t seq      = compressed_msgs_++;
+    compress_raw_bytes_ += size;
+    if (interval > 0 && seq % interval == 0) {
+        std::unique_lock<std::mutex> lock(compress_mux_);
+        compress_sample_ = req;
+    }
+
+    return true;
+}
+
+void Client::on_pong(ClientSession*            session,
+                     std::shared_ptr<PushData> push_data)
+{
+    int64_t      now = Utils::GetSteadyNanoSeconds();
+    int64_t      ts  = 0;
+    PongResponse pong;
+
+    // 优先使用Pong带回的发送时间，服务器未带回时使用最近一次Ping的发送时间
+    if (pong.ParseFromString(push_data->msgdata()) &&
+        !pong.context().empty()) {
+        ts = std::strtoll(pong.context().c_str(), nullptr, 10);
+    }
+    if (ts <= 0 || ts > now) {
+        ts = session->last_ping_ts;
+    }
+    session->last_ping_ts = 0;
+
+    if (ts <= 0) {
+        return;
+    }
+
+    int64_t rtt_us = (now - ts) / 1000;
+
+    std::unique_lock<std::mutex> lock(rtts_mux_);
+    // Ping在切换地址之前发出，经过的是旧连接，RTT不能算到当前地址上
+    if (ts < endpoint_ts_) {
+        log_t("ignore pong of ping sent before switching to {}", endpoint_);
+        return;
+    }
+    RttEstimator& rtt = rtts_[endpoint_];
+    rtt.Update(rtt_us, Config::Instance()->rtt_ewma_alpha);
+    log_t("pong from {}. rtt={}us, ewma={}us", endpoint_, rtt_us, rtt.Ewma());
+}
+
+void Client::send_all_msgs(ClientSession* session)
 {
     int64_t now = Utils::GetSteadyMilliSeconds();
 
-    if (now - last_heartbeat_ts_ >= Config::Instance()->heart_beat_interval) {
-        std::shared_ptr<PushRegReq> req = std::make_shared<PushRegReq>();
-        req->set_uri(StreamURI::PPushGateWayPingURI);
-        st_->Send(req);
-        last_heartbeat_ts_ = now;
+    if (now - session->last_heartbeat_ts >=
+        Config::Instance()->heart_beat_interval) {
+        int64_t                     ping_ts = Utils::GetSteadyNanoSeconds();
+        std::shared_ptr<PushRegReq> req =
+            make_ping_packet(session->uid, ping_ts);
+        if (req) {
+            msgs_sent_++;
+            bytes_sent_ += req->ByteSizeLong();
+            session->st->Send(req);
+            session->last_ping_ts = ping_ts;
+        }
+        session->last_heartbeat_ts = now;
     }
 
-    msg_queue_mux_.lock();
-    st_->SendMsgs(msg_queue_);
-    msg_queue_mux_.unlock();
+    session->msg_queue_mux.lock();
+    for (auto& req : session->msg_queue) {
+        msgs_sent_++;
+        bytes_sent_ += req->ByteSizeLong();
+    }
+    session->st->SendMsgs(session->msg_queue);
+    session->msg_queue_mux.unlock();
 }
 
-int Client::Initialize(uint32_t uid, uint64_t suid)
+int Client::Initialize()
 {
     int ret = PS_RET_SUCCESS;
 
@@ -201,106 +881,109 @@ int Client::Initialize(uint32_t uid, uint64_t suid)
         return PS_RET_ALREADY_INIT;
     }
 
-    last_heartbeat_ts_ = 0;
-    uid_               = uid;
-    suid_              = suid;
-    run_               = true;
-    going_to_quit_     = false;
+    run_           = true;
+    going_to_quit_ = false;
+    reconnect_ts_  = 0;
+    maintain_ts_   = 0;
+    quit_deadline_ = 0;
 
     thread_ = std::unique_ptr<std::thread>(new std::thread([this]() {
-        gpr_timespec tw = gpr_time_from_millis(
-            Config::Instance()->grpc_cq_timeout_ms, GPR_TIMESPAN);
+        gpr_timespec                      tw;
         grpc::CompletionQueue::NextStatus status;
+        void*                             tag;
+        uint32_t                          slot;
         ClientEvent                       event;
         bool                              ok;
 
-        create_channel_and_stub();
-        create_and_init_stream();
+        update_channel_state();
+        start_connect();
 
         while (run_) {
-            status = cq->AsyncNext(reinterpret_cast<void**>(&event), &ok, tw);
+            // 可热更新，每次等待前重新读取
+            tw = gpr_time_from_millis(Config::Instance()->grpc_cq_timeout_ms,
+                                      GPR_TIMESPAN);
+            status = cq->AsyncNext(&tag, &ok, tw);
+
+            slot  = 0;
+            event = ClientEvent::CONNECTED;
+            if (status == grpc::CompletionQueue::GOT_EVENT) {
+                parse_client_tag(tag, slot, event);
+            }
 
             check_and_notify_channel_state();
 
-            std::unique_lock<std::mutex> lock(stream_mux_);
+            // 通道状态监听的tag高位为序号，处理后不再作为会话事件
+            if (status == grpc::CompletionQueue::GOT_EVENT &&
+                event == ClientEvent::CHANNEL_STATE_CHANGED) {
+                if (slot == channel_state_watch_seq_) {
+                    channel_state_watching_ = false;
+                    update_channel_state();
+                }
+                slot = 0;
+            }
+            else if (status == grpc::CompletionQueue::GOT_EVENT &&
+                     static_cast<int>(event) >=
+                         static_cast<int>(ClientEvent::CONNECT_RACE)) {
+                connector_->OnStateChanged(
+                    slot, static_cast<int>(event) -
+                              static_cast<int>(ClientEvent::CONNECT_RACE));
+                slot = 0;
+            }
 
-            switch (status) {
-                case grpc::CompletionQueue::TIMEOUT: {
-                    if (!run_) {
-                        continue;
-                    }
+            if (connector_->IsRacing()) {
+                check_connect_race();
+            }
+            else if (reconnect_ts_ != 0 &&
+                     Utils::GetSteadyMilliSeconds() >= reconnect_ts_) {
+                reconnect_ts_ = 0;
+                start_connect();
+            }
 
-                    if (!ok && st_->IsConnected()) {
-                        st_->Finish();
-                        continue;
-                    }
+            if (is_connection_usable()) {
+                maintain_standby();
+            }
 
-                    if (st_->IsReadyToSend()) {
-                        send_all_msgs();
-                    }
+            std::unique_lock<std::mutex> lock(stream_mux_);
 
-                    break;
+            // 连接断开或重连期间，旧stream上的事件仍需处理直到FINISHED
+            if (status == grpc::CompletionQueue::GOT_EVENT && slot != 0) {
+                auto it = sessions_.find(slot);
+                if (it != sessions_.end() && it->second->st) {
+                    process_stream_event(it->second.get(), event, ok);
                 }
-                case grpc::CompletionQueue::GOT_EVENT: {
-                    if (!run_) {
-                        continue;
-                    }
-
-                    if (event == ClientEvent::FINISHED) {
-                        if (going_to_quit_) {
-                            run_ = false;
-                            continue;
-                        }
-
-                        lock.unlock();
-                        check_and_reconnect();
-                        create_and_init_stream();
-
-                        continue;
-                    }
-                    else if (event == ClientEvent::HALF_CLOSE) {
-                        st_->Finish();
-                        continue;
-                    }
+            }
 
-                    if (!ok && st_->IsConnected()) {
-                        st_->Finish();
-                        continue;
-                    }
+            // 会话较多时不在每个事件后遍历全部会话
+            if (Utils::GetSteadyMilliSeconds() >= maintain_ts_) {
+                maintain_sessions();
+            }
+        }
 
-                    if (ok && st_->IsReadyToSend()) {
-                        send_all_msgs();
-                    }
+        // 释放通道，通道上未返回的状态监听随即以SHUTDOWN返回，不必等到超时
+        stub             = nullptr;
+        channel          = nullptr;
+        standby_channel_ = nullptr;
 
-                    st_->Process(event, ok);
+        // 取出CQ上剩余的事件(如未返回的通道状态监听)，之后才能安全释放CQ
+        cq->Shutdown();
+        while (cq->Next(&tag, &ok)) {}
 
-                    break;
-                }
-                default: {
-                    assert(0);
-                }
-            }
+        std::unique_lock<std::mutex> lock(stream_mux_);
+        for (auto& it : sessions_) {
+            it.second->st = nullptr;
         }
+        sessions_.clear();
+        stream_cond_.notify_all();
     }));
 
-    return ret;
-}
+    init_ = true;
 
-void Client::Send(std::shared_ptr<PushRegReq> req)
-{
-    msg_queue_mux_.lock();
-    msg_queue_.emplace_back(req);
-    msg_queue_mux_.unlock();
+    return ret;
 }
 
 void Client::Destroy()
 {
-    stream_mux_.lock();
     going_to_quit_ = true;
-    if (st_) {
-        st_->HalfClose();
-    }
-    stream_mux_.unlock();
 
     if (thread_) {
         thread_->join();
@@ -309,14 +992,21 @@ void Client::Destroy()
     cq                  = nullptr;
     stub                = nullptr;
     channel             = nullptr;
-    st_                 = nullptr;
     init_               = false;
-    channel_state_lis_  = nullptr;
-    msg_hdl_            = nullptr;
-    stream_status_lis_  = nullptr;
     last_channel_state_ = ChannelState::UNKNOW;
-    last_heartbeat_ts_  = 0;
-    uid_                = 0;
-    suid_               = 0;
+    reconnect_ts_       = 0;
+    standby_channel_    = nullptr;
+    standby_endpoint_   = "";
+    standby_check_ts_   = 0;
+    maintain_ts_        = 0;
+
+    pending_channel_state_    = ChannelState::UNKNOW;
+    pending_channel_state_ts_ = 0;
+    channel_state_watching_   = false;
+
+    stream_mux_.lock();
+    sessions_.clear();
+    stream_cond_.notify_all();
+    stream_mux_.unlock();
 }
 }  // namespace edu
\ No newline at end of file
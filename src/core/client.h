@@ -1,10 +1,18 @@
 #ifndef PUSH_SDK_CLIENT_H
 #define PUSH_SDK_CLIENT_H
 
+#include <common/retry_policy.h>
+#include <common/rtt_estimator.h>
+#include <core/connector.h>
+#include <core/stream.h>
 #include <core/type.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
 #include <thread>
@@ -12,8 +20,6 @@
 
 namespace edu {
 
-class Stream;
-
 class ChannelStateListener {
   public:
     ChannelStateListener() {}
@@ -38,38 +44,100 @@ class MessageHandler {
     virtual void OnMessage(std::shared_ptr<PushData> msg) = 0;
 };
 
+// 挂在连接上的一个会话，每个会话使用独立的stream及suid
+struct ClientSession
+{
+    ClientSession()
+    {
+        slot              = 0;
+        uid               = 0;
+        suid              = 0;
+        st                = nullptr;
+        restart_ts        = 0;
+        last_heartbeat_ts = 0;
+        last_ping_ts      = 0;
+        closing           = false;
+    }
+
+    uint32_t slot;
+    uint32_t uid;
+    uint64_t suid;
+
+    // 为空表示stream未建立或已结束
+    std::unique_ptr<Stream>               st;
+    std::shared_ptr<ChannelStateListener> channel_state_lis;
+    std::shared_ptr<StreamStatusListener> stream_status_lis;
+    std::shared_ptr<MessageHandler>       msg_hdl;
+
+    std::deque<std::shared_ptr<PushRegReq>> msg_queue;
+    std::mutex                              msg_queue_mux;
+
+    // 连接可用时stream结束，只重建该会话的stream
+    std::unique_ptr<RetryPolicy> restart_policy;
+    int64_t                      restart_ts;
+    int64_t                      last_heartbeat_ts;
+    int64_t                      last_ping_ts;
+    bool                         closing;
+};
+
 class Client : public std::enable_shared_from_this<Client> {
     friend class Stream;
 
   public:
-    Client();
+    // channel_id 区分连接池中的连接，不同id的通道不共用底层连接
+    Client(int channel_id = 0);
     virtual ~Client();
 
-    virtual int  Initialize(uint32_t uid, uint64_t suid);
+    virtual int  Initialize();
     virtual void Destroy();
 
-    virtual void
-    SetChannelStateListener(std::shared_ptr<ChannelStateListener> listener);
-
-    virtual void
-    SetClientStatusListener(std::shared_ptr<StreamStatusListener> listener);
-
-    virtual void SetMessageHandler(std::shared_ptr<MessageHandler> hdl);
-
-    virtual void Send(std::shared_ptr<PushRegReq> req);
-    virtual void CleanQueue();
-
-    virtual uint32_t GetUID();
-    virtual uint64_t GetSUID();
+    // 添加会话，stream在连接可用后由CQ线程建立，线程安全
+    virtual std::shared_ptr<ClientSession>
+    AddSession(uint32_t                              uid,
+               uint64_t                              suid,
+               std::shared_ptr<ChannelStateListener> channel_state_lis,
+               std::shared_ptr<StreamStatusListener> stream_status_lis,
+               std::shared_ptr<MessageHandler>       msg_hdl);
+    // 移除会话，等待其stream结束后返回，线程安全
+    virtual void RemoveSession(std::shared_ptr<ClientSession> session);
+
+    virtual void Send(std::shared_ptr<ClientSession> session,
+                      std::shared_ptr<PushRegReq>    req);
+    virtual void CleanQueue(std::shared_ptr<ClientSession> session);
+
+    virtual size_t   GetSessionCount();
+    virtual void     GetTraffic(uint64_t& msgs_sent,
+                                uint64_t& bytes_sent,
+                                uint64_t& msgs_recv,
+                                uint64_t& bytes_recv);
+    virtual uint64_t GetReconnectRetries();
+    virtual void     GetRtt(std::string& endpoint, RttEstimator& rtt);
+    virtual uint64_t GetStandbyFailovers();
+    virtual void     GetCompression(uint64_t& compressed_msgs,
+                                    uint64_t& raw_bytes,
+                                    uint64_t& zip_bytes);
 
   private:
-    void on_read(std::shared_ptr<PushData> push_data);
-    void on_connected();
-    void create_and_init_stream();
-    void create_channel_and_stub(bool need_to_change_port = false);
+    void on_read(ClientSession* session, std::shared_ptr<PushData> push_data);
+    void on_pong(ClientSession* session, std::shared_ptr<PushData> push_data);
+    void on_connected(ClientSession* session);
+    bool on_write(std::shared_ptr<PushRegReq> req);
+    void on_stream_finished(ClientSession* session);
+    void process_stream_event(ClientSession* session,
+                              ClientEvent    event,
+                              bool           ok);
+    void maintain_sessions();
+    bool is_connection_usable();
+    void start_connect();
+    // 按地址创建通道，解析出的IP地址使用原域名作为:authority
+    std::shared_ptr<grpc::Channel> create_channel(const std::string& address);
+    void check_connect_race();
+    void maintain_standby();
+    bool failover_to_standby();
     void check_and_notify_channel_state();
-    void check_and_reconnect();
-    void send_all_msgs();
+    void update_channel_state();
+    void schedule_reconnect();
+    void send_all_msgs(ClientSession* session);
 
   public:
     std::unique_ptr<grpc_impl::CompletionQueue> cq;
@@ -77,24 +145,65 @@ class Client : public std::enable_shared_from_this<Client> {
     std::shared_ptr<grpc_impl::Channel>         channel;
 
   private:
-    std::unique_ptr<Stream>               st_;
-    bool                                  init_;
-    std::unique_ptr<std::thread>          thread_;
-    bool                                  run_;
-    bool                                  going_to_quit_;
-    std::shared_ptr<ChannelStateListener> channel_state_lis_;
-    std::shared_ptr<MessageHandler>       msg_hdl_;
-    std::shared_ptr<StreamStatusListener> stream_status_lis_;
-    ChannelState                          last_channel_state_;
-    int64_t                               last_heartbeat_ts_;
-    uint32_t                              uid_;
-    uint64_t                              suid_;
-
-    std::deque<std::shared_ptr<PushRegReq>> msg_queue_;
-    std::mutex                              msg_queue_mux_;
-    std::mutex                              stream_mux_;
-
-    static std::atomic<uint32_t> port_index_;
+    bool                           init_;
+    std::unique_ptr<std::thread>   thread_;
+    bool                           run_;
+    bool                           going_to_quit_;
+    ChannelState                   last_channel_state_;
+    ChannelState                   pending_channel_state_;
+    int64_t                        pending_channel_state_ts_;
+    bool                           channel_state_watching_;
+    uint32_t                       channel_state_watch_seq_;
+    std::unique_ptr<RetryPolicy>   reconnect_policy_;
+    int64_t                        reconnect_ts_;
+    std::unique_ptr<Connector>     connector_;
+    std::string                    endpoint_;
+    // endpoint_切换的时间(ns)，早于该时间发出的Ping的RTT不计入新地址
+    int64_t                        endpoint_ts_;
+    std::vector<std::string>       race_addresses_;
+    std::shared_ptr<grpc::Channel> standby_channel_;
+    std::string                    standby_endpoint_;
+    int64_t                        standby_check_ts_;
+    std::atomic<uint64_t>          standby_failovers_;
+    int64_t                        maintain_ts_;
+    int64_t                        quit_deadline_;
+    int                            channel_id_;
+    std::atomic<uint64_t>          msgs_sent_;
+    std::atomic<uint64_t>          bytes_sent_;
+    std::atomic<uint64_t>          msgs_recv_;
+    std::atomic<uint64_t>          bytes_recv_;
+    grpc_compression_algorithm     compression_algorithm_;
+    std::atomic<uint64_t>          compressed_msgs_;
+    std::atomic<uint64_t>          compress_raw_bytes_;
+    // 压缩率抽样: CQ线程只保存消息引用，统计线程上再做deflate估算
+    std::shared_ptr<PushRegReq>    compress_sample_;
+    uint64_t                       compress_sample_raw_;
+    uint64_t                       compress_sample_zip_;
+    std::mutex                     compress_mux_;
+
+    // 竞速地址到原始host:port的映射，用于设置:authority
+    std::map<std::string, std::string> authorities_;
+
+    // 会话序号从1开始，0留给连接自身的事件
+    std::map<uint32_t, std::shared_ptr<ClientSession>> sessions_;
+    uint32_t                                           next_slot_;
+    std::mutex                                         stream_mux_;
+    std::condition_variable                            stream_cond_;
+
+    static grpc::ChannelArguments     get_channel_args(int channel_id);
+    static std::vector<std::string>   get_endpoints(
+          std::map<std::string, std::string>* authorities = nullptr);
+    static grpc_compression_algorithm get_compression_algorithm();
+    // 按预设及单独配置设置HTTP/2流控参数
+    static void set_flow_control_args(grpc::ChannelArguments& args);
+
+    // 上次连接竞速胜出的地址序号
+    static std::atomic<uint32_t> preferred_endpoint_;
+    // 进程内固定的随机数，决定从解析结果中的哪个地址开始连接
+    static uint32_t spread_seed_;
+    // 各地址的心跳RTT，重连时RTT小的地址优先
+    static std::map<std::string, RttEstimator> rtts_;
+    static std::mutex                          rtts_mux_;
 };
 }  // namespace edu
 #endif
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <common/config.h>
+#include <common/log.h>
+#include <common/utils.h>
+#include <core/connector.h>
+
+#include <algorithm>
+
+namespace edu {
+
+Connector::Connector(grpc::CompletionQueue* cq, ChannelFactory factory)
+{
+    cq_             = cq;
+    factory_        = factory;
+    next_launch_ts_ = 0;
+    seq_            = 0;
+    racing_         = false;
+    failed_         = false;
+}
+
+Connector::~Connector()
+{
+    Stop();
+}
+
+void Connector::Start(const std::vector<std::string>& addresses)
+{
+    Stop();
+
+    addresses_ = addresses;
+    if (addresses_.size() > CONNECT_RACE_MAX_CANDIDATES) {
+        log_w("too many addresses to race. use first {} of {}",
+              CONNECT_RACE_MAX_CANDIDATES, addresses_.size());
+        addresses_.resize(CONNECT_RACE_MAX_CANDIDATES);
+    }
+    candidates_.clear();
+    next_launch_ts_ = 0;
+    seq_            = (seq_ + 1) & CLIENT_TAG_SEQ_MASK;
+    racing_         = !addresses_.empty();
+    failed_         = addresses_.empty();
+    winner_         = "";
+
+    Poll();
+}
+
+void Connector::Stop()
+{
+    // 释放候选通道后，通道上未返回的监听以SHUTDOWN返回
+    for (Candidate& c : candidates_) {
+        c.channel = nullptr;
+    }
+    racing_ = false;
+}
+
+void Connector::OnStateChanged(uint32_t seq, int index)
+{
+    if (seq != seq_ || index < 0 ||
+        static_cast<size_t>(index) >= candidates_.size()) {
+        return;
+    }
+    candidates_[index].watching = false;
+}
+
+std::shared_ptr<grpc::Channel> Connector::Poll()
+{
+    if (!racing_) {
+        return nullptr;
+    }
+
+    int64_t now    = Utils::GetSteadyMilliSeconds();
+    size_t  active = 0;
+
+    for (size_t i = 0; i < candidates_.size(); i++) {
+        Candidate& c = candidates_[i];
+        if (c.failed || !c.channel) {
+            continue;
+        }
+
+        grpc_connectivity_state state = c.channel->GetState(true);
+        if (state == GRPC_CHANNEL_READY) {
+            log_i("connect race won by {}", c.address);
+            std::shared_ptr<grpc::Channel> channel = c.channel;
+            winner_                                = c.address;
+            Stop();
+            return channel;
+        }
+        else if (state == GRPC_CHANNEL_TRANSIENT_FAILURE ||
+                 state == GRPC_CHANNEL_SHUTDOWN) {
+            log_w("connect to {} failed", c.address);
+            c.failed  = true;
+            c.channel = nullptr;
+            // 失败后立刻尝试下一个地址
+            next_launch_ts_ = now;
+        }
+        else {
+            active++;
+            watch(i, state);
+        }
+    }
+
+    size_t width =
+        std::max(1, Config::Instance()->grpc_connect_race_width.load());
+    if (candidates_.size() < addresses_.size() && now >= next_launch_ts_ &&
+        active < width) {
+        launch(candidates_.size());
+        next_launch_ts_ =
+            now + Config::Instance()->grpc_connect_race_stagger_ms;
+        active++;
+    }
+
+    if (active == 0 && candidates_.size() >= addresses_.size()) {
+        log_w("connect race failed. all {} addresses unreachable",
+              addresses_.size());
+        racing_ = false;
+        failed_ = true;
+    }
+
+    return nullptr;
+}
+
+bool Connector::IsRacing()
+{
+    return racing_;
+}
+
+bool Connector::IsFailed()
+{
+    return failed_;
+}
+
+std::string Connector::WinnerAddress()
+{
+    return winner_;
+}
+
+void Connector::launch(size_t index)
+{
+    Candidate c;
+    c.address  = addresses_[index];
+    c.channel  = factory_(c.address);
+    c.watching = false;
+    c.failed   = false;
+    log_t("connect race start {}", c.address);
+
+    candidates_.push_back(c);
+    watch(index, c.channel->GetState(true));
+}
+
+void Connector::watch(size_t index, grpc_connectivity_state last_state)
+{
+    Candidate& c = candidates_[index];
+    if (c.watching) {
+        return;
+    }
+
+    c.channel->NotifyOnStateChange(
+        last_state,
+        std::chrono::system_clock::now() +
+            std::chrono::milliseconds(Config::Instance()->grpc_wait_connect_ms),
+        cq_,
+        make_client_tag(seq_, static_cast<ClientEvent>(
+                                  static_cast<int>(ClientEvent::CONNECT_RACE) +
+                                  static_cast<int>(index))));
+    c.watching = true;
+}
+
+}  // namespace edu
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef EDU_PUSH_SDK_CONNECTOR_H
+#define EDU_PUSH_SDK_CONNECTOR_H
+
+#include <core/type.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace edu {
+
+// happy eyeballs 风格的连接器：按间隔依次向多个地址发起连接，
+// 某个地址连接失败时立刻尝试下一个，使用最先READY的通道。
+// 只在CQ线程中使用，非线程安全
+class Connector {
+  public:
+    using ChannelFactory =
+        std::function<std::shared_ptr<grpc::Channel>(const std::string&)>;
+
+    Connector(grpc::CompletionQueue* cq, ChannelFactory factory);
+    virtual ~Connector();
+
+  public:
+    // addresses 按优先级排序，最多使用前CONNECT_RACE_MAX_CANDIDATES个
+    virtual void Start(const std::vector<std::string>& addresses);
+    virtual void Stop();
+    // 处理CQ上的候选通道状态变化事件，之前竞速的事件直接丢弃
+    virtual void OnStateChanged(uint32_t seq, int index);
+    // 检查候选通道状态并按需发起下一个连接，有通道READY时返回该通道
+    virtual std::shared_ptr<grpc::Channel> Poll();
+
+    virtual bool        IsRacing();
+    virtual bool        IsFailed();
+    virtual std::string WinnerAddress();
+
+  private:
+    struct Candidate
+    {
+        std::string                    address;
+        std::shared_ptr<grpc::Channel> channel;
+        bool                           watching;
+        bool                           failed;
+    };
+
+    void launch(size_t index);
+    void watch(size_t index, grpc_connectivity_state last_state);
+
+  private:
+    grpc::CompletionQueue*   cq_;
+    ChannelFactory           factory_;
+    std::vector<std::string> addresses_;
+    std::vector<Candidate>   candidates_;
+    int64_t                  next_launch_ts_;
+    uint32_t                 seq_;
+    bool                     racing_;
+    bool                     failed_;
+    std::string              winner_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
@@ -4,9 +4,31 @@
 #include <common/utils.h>
 #include <core/core.h>
 #include <core/packet.h>
+#include <core/session_manager.h>
+
+#include <algorithm>
+#include <cstring>
 
 namespace edu {
 
+struct TerminalEventInfo
+{
+    PushSDKCBType  type;
+    PushSDKCBEvent res;
+    const char*    desc;
+};
+
+// 按PushSDK::TerminalEvent排列
+static const TerminalEventInfo TERMINAL_EVENTS[] = {
+    {PS_CB_TYPE_LOGIN, PS_CB_EVENT_USER_KICKED_BY_SRV,
+     "user be kicked by the server"},
+    {PS_CB_TYPE_LOGIN, PS_CB_EVENT_FAILED,
+     "inner relogin: retry budget exhausted. you should relogin manually"},
+    {PS_CB_TYPE_JOIN_GROUP, PS_CB_EVENT_FAILED,
+     "inner rejoin group: retry budget exhausted. you should rejoin all group "
+     "manually"},
+};
+
 PushSDK::PushSDK()
 {
     init_         = false;
@@ -17,17 +39,28 @@ PushSDK::PushSDK()
     event_cb_     = nullptr;
     event_cb_arg_ = nullptr;
     client_       = nullptr;
+    session_      = nullptr;
     logining_     = false;
     desc_         = "ok";
     code_         = RES_SUCCESS;
 
-    user_                    = nullptr;
-    
-    cb_map_thread_           = nullptr;
-    cb_map_thread_quit_flag_ = true;
+    user_ = nullptr;
+
+    relogin_policy_   = nullptr;
+    rejoin_policy_    = nullptr;
+    relogin_retry_ts_ = 0;
+    rejoin_retry_ts_  = 0;
+
+    terminal_events_ = 0;
+    event_pending_   = false;
+    event_drops_     = 0;
+    event_next_      = nullptr;
+    event_queueable_ = false;
+}
 
-    event_cb_thread_           = nullptr;
-    event_cb_thread_quit_flag_ = true;
+std::shared_ptr<PushSDK> PushSDK::CreateSession()
+{
+    return std::shared_ptr<PushSDK>(new PushSDK);
 }
 
 int PushSDK::Initialize(uint32_t       uid,
@@ -51,116 +84,158 @@ int PushSDK::Initialize(uint32_t       uid,
     event_cb_     = cb_func;
     event_cb_arg_ = cb_args;
 
-    client_ = std::make_shared<Client>();
-    client_->SetChannelStateListener(this->shared_from_this());
-    client_->SetClientStatusListener(this->shared_from_this());
-    client_->SetMessageHandler(this->shared_from_this());
-    if ((ret = client_->Initialize(uid_, suid_)) != PS_RET_SUCCESS) {
-        log_e("client create channel failed. ret={}", PS_RET_SUCCESS);
+    relogin_policy_ = std::unique_ptr<RetryPolicy>(new RetryPolicy(
+        Config::Instance()->retry_backoff_base_ms,
+        Config::Instance()->retry_backoff_cap_ms,
+        Config::Instance()->retry_backoff_multiplier,
+        Config::Instance()->retry_budget_per_session));
+    rejoin_policy_ = std::unique_ptr<RetryPolicy>(new RetryPolicy(
+        Config::Instance()->retry_backoff_base_ms,
+        Config::Instance()->retry_backoff_cap_ms,
+        Config::Instance()->retry_backoff_multiplier,
+        Config::Instance()->retry_budget_per_session));
+    relogin_retry_ts_ = 0;
+    rejoin_retry_ts_  = 0;
+
+    client_ = SessionManager::Instance()->GetClient(suid_);
+    if (!client_) {
+        ret = PS_RET_SDK_UNINIT;
+        log_e("no client available. ret={}", ret);
         return ret;
     }
+    session_ = client_->AddSession(uid_, suid_, this->shared_from_this(),
+                                   this->shared_from_this(),
+                                   this->shared_from_this());
+    SessionManager::Instance()->AddSession(this->shared_from_this());
+
+    init_ = true;
+
+    return ret;
+}
 
-    cb_map_thread_quit_flag_ = false;
-    cb_map_thread_ = std::unique_ptr<std::thread>(new std::thread([this]() {
-        while (!cb_map_thread_quit_flag_) {
-            {
-                std::unique_lock<std::mutex> lock(cb_map_mux_);
-
-                if (!cb_map_thread_quit_flag_) {
-                    cb_map_cond_.wait_for(
-                        lock,
-                        std::chrono::milliseconds(
-                            Config::Instance()->call_check_timeout_interval));
-                }
-                if (cb_map_thread_quit_flag_) {
-                    return;
-                }
+int64_t PushSDK::CheckCalls(int64_t now)
+{
+    std::vector<std::shared_ptr<CallContext>> timeout_ctxs;
+    bool                                      need_relogin = false;
+    bool                                      need_rejoin  = false;
+
+    // 没有未完成的调用和重试时返回0
+    int64_t next    = 0;
+    auto    earlier = [&next](int64_t ts) {
+        if (next == 0 || ts < next) {
+            next = ts;
+        }
+    };
+
+    {
+        // 每个调用的超时时间不同，需要遍历全部，并计算下次检测的时间
+        std::unique_lock<std::mutex> lock(cb_map_mux_);
+        auto                         it = cb_map_.begin();
+        while (it != cb_map_.end()) {
+            if (it->second->deadline <= now) {
+                timeout_ctxs.push_back(it->second);
+                it = cb_map_.erase(it);
             }
-            int64_t now = Utils::GetSteadyNanoSeconds();
-            std::map<int64_t, std::shared_ptr<CallContext>>::iterator it;
-
-            while (!cb_map_.empty()) {
-                it = cb_map_.begin();
-
-                int64_t                      call_time = it->first;
-                std::shared_ptr<CallContext> ctx       = it->second;
-
-                if (Utils::NanoSecondsToMilliSeconds(now - call_time) >=
-                    Config::Instance()->call_timeout_interval) {
-                    handle_timeout_response(ctx);
-                    notify(ctx, PS_CB_EVENT_TIMEOUT, "timeout", RES_ETIMEOUT);
-                    cb_map_.erase(it);
-                }
-                else {
-                    break;
-                }
+            else {
+                earlier(it->second->deadline);
+                it++;
             }
         }
-    }));
-
-    event_cb_thread_quit_flag_ = false;
-    event_cb_thread_ = std::unique_ptr<std::thread>(new std::thread([this]() {
-        std::deque<std::shared_ptr<EventCBContext>> temp_pctxs;
-        while (!event_cb_thread_quit_flag_) {
-            {
-                std::unique_lock<std::mutex> lock(event_cb_mux_);
-                if (!event_cb_pctxs_.empty()) {
-                    std::swap(event_cb_pctxs_, temp_pctxs);
-                }
-                else if (!event_cb_thread_quit_flag_) {
-                    event_cb_cond_.wait(lock);
-                }
-            }
 
-            while (!temp_pctxs.empty()) {
-                std::shared_ptr<EventCBContext>& ctx = temp_pctxs.front();
-                event_cb_(ctx->type, ctx->res, ctx->desc.c_str(),
-                          event_cb_arg_);
-
-                // upload elk
-                int code = PS_RET_SUCCESS;
-                if (ctx->res == PS_CB_EVENT_TIMEOUT) {
-                    code = PS_RET_CALL_TIMEOUT;
-                }
-                else if (ctx->res != PS_CB_EVENT_OK) {
-                    code = PS_RET_CALL_FAILED;
-                }
-                else {
-                    // ignore
-                }
-
-                switch (ctx->type) {
-                    case PS_CB_TYPE_LOGIN: {
-                        ELK_UPLOAD(appid_, uid_, suid_, "", "ReLogin", code,
-                                   ctx->desc);
-                        break;
-                    }
-                    case PS_CB_TYPE_JOIN_GROUP: {
-                        user_mux_.lock();
-                        std::string str = dump_all_group_info();
-                        user_mux_.unlock();
-                        ELK_UPLOAD(appid_, uid_, suid_, str, "ReJoinGroup",
-                                   code, ctx->desc);
-                        break;
-                    }
-                    default: break;
-                }
-
-                temp_pctxs.pop_front();
-            }
+        // 到期的退避重试
+        if (relogin_retry_ts_ != 0 && relogin_retry_ts_ <= now) {
+            relogin_retry_ts_ = 0;
+            need_relogin      = true;
+        }
+        else if (relogin_retry_ts_ != 0) {
+            earlier(relogin_retry_ts_);
         }
-    }));
+        if (rejoin_retry_ts_ != 0 && rejoin_retry_ts_ <= now) {
+            rejoin_retry_ts_ = 0;
+            need_rejoin      = true;
+        }
+        else if (rejoin_retry_ts_ != 0) {
+            earlier(rejoin_retry_ts_);
+        }
+    }
 
-    event_cb_thread_id_ = event_cb_thread_->get_id();
+    // 不持有cb_map_mux_处理超时，避免与user_mux_死锁
+    for (std::shared_ptr<CallContext>& ctx : timeout_ctxs) {
+        handle_timeout_response(ctx);
+        notify(ctx, PS_CB_EVENT_TIMEOUT, "timeout", RES_ETIMEOUT);
+    }
 
-    init_ = true;
+    if (need_relogin) {
+        relogin(true, true);
+    }
+    if (need_rejoin) {
+        rejoin_group(true);
+    }
 
-    return ret;
+    return next;
+}
+
+void PushSDK::DispatchEvents()
+{
+    // 先清除标记再取事件，取事件期间投递的事件会再次通知
+    event_pending_ = false;
+
+    EventCBContext ctx;
+    while (event_ring_.Pop(ctx)) {
+        dispatch_event(ctx);
+        release_event(ctx);
+    }
+
+    // 队列满时合并记录的事件
+    uint32_t terminal = terminal_events_.exchange(0);
+    for (int i = 0; i < TERMINAL_EVENT_COUNT; i++) {
+        if (terminal & (1u << i)) {
+            ctx.type = TERMINAL_EVENTS[i].type;
+            ctx.res  = TERMINAL_EVENTS[i].res;
+            ctx.desc = TERMINAL_EVENTS[i].desc;
+            ctx.text = -1;
+            dispatch_event(ctx);
+        }
+    }
+}
+
+void PushSDK::dispatch_event(const EventCBContext& ctx)
+{
+    const char* desc = event_desc(ctx);
+    event_cb_(ctx.type, ctx.res, desc, event_cb_arg_);
+
+    // upload elk
+    int code = PS_RET_SUCCESS;
+    if (ctx.res == PS_CB_EVENT_TIMEOUT) {
+        code = PS_RET_CALL_TIMEOUT;
+    }
+    else if (ctx.res != PS_CB_EVENT_OK) {
+        code = PS_RET_CALL_FAILED;
+    }
+    else {
+        // ignore
+    }
+
+    switch (ctx.type) {
+        case PS_CB_TYPE_LOGIN: {
+            ELK_UPLOAD(appid_, uid_, suid_, "", "ReLogin", code, desc);
+            break;
+        }
+        case PS_CB_TYPE_JOIN_GROUP: {
+            user_mux_.lock();
+            std::string str = dump_all_group_info();
+            user_mux_.unlock();
+            ELK_UPLOAD(appid_, uid_, suid_, str, "ReJoinGroup", code, desc);
+            break;
+        }
+        default: break;
+    }
 }
 
 void PushSDK::NotifyChannelState(ChannelState state)
 {
     log_w("channel_state={}", channel_state_to_string(state));
+    std::unique_lock<std::mutex> lock(hdls_mux_);
     for (auto it = hdls_.begin(); it != hdls_.end(); it++) {
         if ((*it)->conn_state_cb) {
             (*it)->conn_state_cb(state == ChannelState::OK ?
@@ -172,6 +247,8 @@ void PushSDK::NotifyChannelState(ChannelState state)
 
 void PushSDK::OnConnected()
 {
+    // 重新连接后会立刻重登，之前计划的退避重试不再需要
+    cancel_all_retries();
     relogin();
 }
 
@@ -217,58 +294,60 @@ void PushSDK::OnMessage(std::shared_ptr<PushData> msg)
     }
 }
 
-void PushSDK::Destroy()
+int PushSDK::Destroy()
 {
     if (!init_) {
-        return;
+        return PS_RET_SUCCESS;
     }
 
-    // 防止在全局回调线程中调用Destroy()
-    if (event_cb_thread_id_ == std::this_thread::get_id()) {
-        throw std::runtime_error("trying to join itself");
+    // 防止在SDK内部线程中调用Destroy()，会等待这些线程处理完该会话，
+    // 不能抛异常，异常穿过C接口会直接终止进程
+    if (SessionManager::Instance()->IsInnerThread()) {
+        log_e("destroy session in sdk inner thread is not allowed");
+        return PS_RET_IN_SDK_THREAD;
     }
 
-    event_cb_mux_.lock();
-    event_cb_thread_quit_flag_ = true;
-    event_cb_cond_.notify_all();
-    event_cb_mux_.unlock();
-
-    event_cb_thread_->join();
-    event_cb_thread_.reset();
-    event_cb_thread_ = nullptr;
-
-    cb_map_mux_.lock();
-    cb_map_thread_quit_flag_ = true;
-    cb_map_cond_.notify_all();
-    cb_map_mux_.unlock();
-
-    cb_map_thread_->join();
-    cb_map_thread_.reset();
-    cb_map_thread_ = nullptr;
+    // 先移除stream，之后不会再收到消息及连接事件
+    client_->RemoveSession(session_);
+    SessionManager::Instance()->RemoveSession(this);
 
-    event_cb_pctxs_.clear();
+    EventCBContext ev;
+    while (event_ring_.Pop(ev)) {
+        release_event(ev);
+    }
+    terminal_events_ = 0;
+    event_pending_   = false;
 
-    client_->Destroy();
-    client_.reset();
-    client_ = nullptr;
-    init_   = false;
+    session_ = nullptr;
+    client_  = nullptr;
+    init_    = false;
 
+    cb_map_mux_.lock();
+    relogin_retry_ts_ = 0;
+    rejoin_retry_ts_  = 0;
     cb_map_.clear();
+    cb_map_mux_.unlock();
 
     user_.reset();
     user_ = nullptr;
     groups_.clear();
+
+    destroy_handlers();
+    return PS_RET_SUCCESS;
 }
 
 PushSDK::~PushSDK()
 {
     Destroy();
+    // 未初始化的会话也可能创建过句柄
+    destroy_handlers();
 }
 
 int PushSDK::Login(const PushSDKUserInfo& user,
                    bool                   is_sync,
                    PushSDKEventCB         cb_func,
-                   void*                  cb_args)
+                   void*                  cb_args,
+                   int                    timeout_ms)
 {
     int ret = PS_RET_SUCCESS;
     if (!init_) {
@@ -281,7 +360,7 @@ int PushSDK::Login(const PushSDKUserInfo& user,
     std::unique_lock<std::mutex> user_lock(user_mux_);
 
     // 登录之前，清理所有未发出的请求
-    client_->CleanQueue();
+    client_->CleanQueue(session_);
 
     if (user_) {
         ret = PS_RET_ALREADY_LOGIN;
@@ -305,14 +384,19 @@ int PushSDK::Login(const PushSDKUserInfo& user,
     *user_ptr                 = user;
     user_.reset(user_ptr);
 
+    // 新的登录会话，恢复重试预算
+    relogin_policy_->ResetBudget();
+    rejoin_policy_->ResetBudget();
+
     logining_ = true;
 
     if (is_sync) {
         user_lock.unlock();
-        ret = call_sync(PS_CB_TYPE_LOGIN, req, now);
+        ret = call_sync(PS_CB_TYPE_LOGIN, req, now, 0, 0, timeout_ms);
     }
     else {
-        call(PS_CB_TYPE_LOGIN, req, now, cb_func, cb_args);
+        call(PS_CB_TYPE_LOGIN, req, now, cb_func, cb_args, 0, 0, false, true,
+             timeout_ms);
     }
 
     ELK_UPLOAD(appid_, uid_, suid_, "", "Login", ret, desc_);
@@ -320,7 +404,10 @@ int PushSDK::Login(const PushSDKUserInfo& user,
     return ret;
 }
 
-int PushSDK::Logout(bool is_sync, PushSDKEventCB cb_func, void* cb_args)
+int PushSDK::Logout(bool           is_sync,
+                    PushSDKEventCB cb_func,
+                    void*          cb_args,
+                    int            timeout_ms)
 {
     int ret = PS_RET_SUCCESS;
 
@@ -345,13 +432,15 @@ int PushSDK::Logout(bool is_sync, PushSDKEventCB cb_func, void* cb_args)
     // 清理登录信息
     remove_all_group_info();
     user_ = nullptr;
+    cancel_all_retries();
 
     if (is_sync) {
         user_lock.unlock();
-        ret = call_sync(PS_CB_TYPE_LOGOUT, req, now);
+        ret = call_sync(PS_CB_TYPE_LOGOUT, req, now, 0, 0, timeout_ms);
     }
     else {
-        call(PS_CB_TYPE_LOGOUT, req, now, cb_func, cb_args);
+        call(PS_CB_TYPE_LOGOUT, req, now, cb_func, cb_args, 0, 0, false, true,
+             timeout_ms);
     }
 
     ELK_UPLOAD(appid_, uid_, suid_, "", "Logout", ret, desc_);
@@ -362,7 +451,8 @@ int PushSDK::Logout(bool is_sync, PushSDKEventCB cb_func, void* cb_args)
 int PushSDK::JoinGroup(const PushSDKGroupInfo& group,
                        bool                    is_sync,
                        PushSDKEventCB          cb_func,
-                       void*                   cb_args)
+                       void*                   cb_args,
+                       int                     timeout_ms)
 {
     int ret = PS_RET_SUCCESS;
 
@@ -398,12 +488,12 @@ int PushSDK::JoinGroup(const PushSDKGroupInfo& group,
 
     if (is_sync) {
         user_lock.unlock();
-        ret =
-            call_sync(PS_CB_TYPE_JOIN_GROUP, req, now, group.gtype, group.gid);
+        ret = call_sync(PS_CB_TYPE_JOIN_GROUP, req, now, group.gtype,
+                        group.gid, timeout_ms);
     }
     else {
         call(PS_CB_TYPE_JOIN_GROUP, req, now, cb_func, cb_args, group.gtype,
-             group.gid);
+             group.gid, false, true, timeout_ms);
     }
 
     ELK_UPLOAD(appid_, uid_, suid_, dump_group_info(group), "JoinGroup", ret,
@@ -415,7 +505,8 @@ int PushSDK::JoinGroup(const PushSDKGroupInfo& group,
 int PushSDK::LeaveGroup(const PushSDKGroupInfo& group,
                         bool                    is_sync,
                         PushSDKEventCB          cb_func,
-                        void*                   cb_args)
+                        void*                   cb_args,
+                        int                     timeout_ms)
 {
     int ret = PS_RET_SUCCESS;
 
@@ -449,12 +540,12 @@ int PushSDK::LeaveGroup(const PushSDKGroupInfo& group,
 
     if (is_sync) {
         user_lock.unlock();
-        ret =
-            call_sync(PS_CB_TYPE_LEAVE_GROUP, req, now, group.gtype, group.gid);
+        ret = call_sync(PS_CB_TYPE_LEAVE_GROUP, req, now, group.gtype,
+                        group.gid, timeout_ms);
     }
     else {
         call(PS_CB_TYPE_LEAVE_GROUP, req, now, cb_func, cb_args, group.gtype,
-             group.gid);
+             group.gid, false, true, timeout_ms);
     }
 
     ELK_UPLOAD(appid_, uid_, suid_, dump_group_info(group), "LeaveGroup", ret,
@@ -463,15 +554,79 @@ int PushSDK::LeaveGroup(const PushSDKGroupInfo& group,
     return ret;
 }
 
+void PushSDK::CancelCall(PushSDKCBType type, const PushSDKGroupInfo* group)
+{
+    std::vector<std::shared_ptr<CallContext>> ctxs;
+
+    {
+        std::unique_lock<std::mutex> lock(cb_map_mux_);
+        auto                         it = cb_map_.begin();
+        while (it != cb_map_.end()) {
+            // SDK内部的重试调用不允许取消，指定了组时只取消该组的调用
+            std::shared_ptr<CallContext>& ctx = it->second;
+            if (ctx->type == type && !ctx->is_retry &&
+                (!group ||
+                 (ctx->gtype == group->gtype && ctx->gid == group->gid))) {
+                ctxs.push_back(ctx);
+                it = cb_map_.erase(it);
+            }
+            else {
+                it++;
+            }
+        }
+    }
+
+    for (std::shared_ptr<CallContext>& ctx : ctxs) {
+        handle_canceled_response(ctx);
+        notify(ctx, PS_CB_EVENT_CANCELED, "canceled", RES_ECANCELED);
+    }
+}
+
 void PushSDK::GetLastError(std::string& desc, int& code)
 {
     desc = desc_;
     code = code_;
 }
 
+void PushSDK::GetAppInfo(uint64_t& appid, uint64_t& appkey)
+{
+    appid  = appid_;
+    appkey = appkey_;
+}
+
+void PushSDK::GetStats(PushSDKStats& stats)
+{
+    if (!init_) {
+        return;
+    }
+
+    stats.relogin_retries   = relogin_policy_->TotalRetries();
+    stats.rejoin_retries    = rejoin_policy_->TotalRetries();
+    stats.reconnect_retries = client_->GetReconnectRetries();
+
+    std::string  endpoint;
+    RttEstimator rtt;
+    client_->GetRtt(endpoint, rtt);
+    snprintf(stats.endpoint, sizeof(stats.endpoint), "%s", endpoint.c_str());
+    stats.rtt_ewma_us = rtt.Ewma();
+    stats.rtt_min_us  = rtt.Min();
+    stats.rtt_max_us  = rtt.Max();
+    stats.rtt_samples = rtt.Samples();
+
+    stats.standby_failovers = client_->GetStandbyFailovers();
+    stats.dropped_events    = event_drops_;
+}
+
+std::set<Handler*> PushSDK::live_hdls_;
+std::mutex         PushSDK::live_hdls_mux_;
+
 Handler* PushSDK::CreateHandler()
 {
     Handler* hdl = new Handler;
+    hdl->owner   = this;
+
+    std::unique_lock<std::mutex> live_lock(live_hdls_mux_);
+    live_hdls_.insert(hdl);
     hdls_mux_.lock();
     hdls_.push_back(hdl);
     hdls_mux_.unlock();
@@ -480,45 +635,61 @@ Handler* PushSDK::CreateHandler()
 
 void PushSDK::DestroyHandler(Handler* hdl)
 {
-    std::unique_lock<std::mutex> lock(hdls_mux_);
-    for (auto it = hdls_.begin(); it != hdls_.end(); it++) {
-        if (*it == hdl) {
-            delete hdl;
-            hdls_.erase(it);
-            return;
-        }
+    std::unique_lock<std::mutex> live_lock(live_hdls_mux_);
+    if (live_hdls_.erase(hdl) == 0) {
+        return;
     }
+
+    PushSDK*                     owner = hdl->owner;
+    std::unique_lock<std::mutex> lock(owner->hdls_mux_);
+    owner->hdls_.erase(
+        std::remove(owner->hdls_.begin(), owner->hdls_.end(), hdl),
+        owner->hdls_.end());
+    delete hdl;
 }
 
 void PushSDK::AddUserMsgCBToHandler(Handler* hdl, PushSDKUserMsgCB cb)
 {
-    std::unique_lock<std::mutex> lock(hdls_mux_);
-    for (auto it = hdls_.begin(); it != hdls_.end(); it++) {
-        if (*it == hdl) {
-            (*it)->user_msg_cb = cb;
-            return;
-        }
+    std::unique_lock<std::mutex> live_lock(live_hdls_mux_);
+    if (live_hdls_.count(hdl) == 0) {
+        return;
     }
+
+    std::unique_lock<std::mutex> lock(hdl->owner->hdls_mux_);
+    hdl->user_msg_cb = cb;
 }
+
 void PushSDK::AddGroupMsgCBToHandler(Handler* hdl, PushSDKGroupMsgCB cb)
 {
-    std::unique_lock<std::mutex> lock(hdls_mux_);
-    for (auto it = hdls_.begin(); it != hdls_.end(); it++) {
-        if (*it == hdl) {
-            (*it)->group_msg_cb = cb;
-            return;
-        }
+    std::unique_lock<std::mutex> live_lock(live_hdls_mux_);
+    if (live_hdls_.count(hdl) == 0) {
+        return;
     }
+
+    std::unique_lock<std::mutex> lock(hdl->owner->hdls_mux_);
+    hdl->group_msg_cb = cb;
 }
+
 void PushSDK::AddConnStateCBToHandler(Handler* hdl, PushSDKConnStateCB cb)
 {
+    std::unique_lock<std::mutex> live_lock(live_hdls_mux_);
+    if (live_hdls_.count(hdl) == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(hdl->owner->hdls_mux_);
+    hdl->conn_state_cb = cb;
+}
+
+void PushSDK::destroy_handlers()
+{
+    std::unique_lock<std::mutex> live_lock(live_hdls_mux_);
     std::unique_lock<std::mutex> lock(hdls_mux_);
-    for (auto it = hdls_.begin(); it != hdls_.end(); it++) {
-        if (*it == hdl) {
-            (*it)->conn_state_cb = cb;
-            return;
-        }
+    for (Handler* hdl : hdls_) {
+        live_hdls_.erase(hdl);
+        delete hdl;
     }
+    hdls_.clear();
 }
 
 void PushSDK::relogin(bool need_to_lock, bool is_timeout)
@@ -539,12 +710,9 @@ void PushSDK::relogin(bool need_to_lock, bool is_timeout)
             ELK_UPLOAD(appid_, uid_, suid_, "", "ReLogin",
                        PS_RET_REQ_ENC_FAILED,
                        "inner relogin: LoginRequest packet serialize failed");
-            std::unique_lock<std::mutex> lock(event_cb_mux_);
-            event_cb_pctxs_.emplace_back(std::make_shared<EventCBContext>(
-                PS_CB_TYPE_LOGIN, PS_CB_EVENT_REQ_ENC_FAILED,
-                "inner relogin: LoginRequest packet serialize failed. you "
-                "should relogin manually"));
-            event_cb_cond_.notify_one();
+            post_event(PS_CB_TYPE_LOGIN, PS_CB_EVENT_REQ_ENC_FAILED,
+                       "inner relogin: LoginRequest packet serialize failed. "
+                       "you should relogin manually");
         }
 
         return;
@@ -578,13 +746,9 @@ void PushSDK::rejoin_group(bool need_to_lock)
                 appid_, uid_, suid_, dump_str, "ReJoinGroup",
                 PS_RET_REQ_ENC_FAILED,
                 "inner rejoin group: JoinGroupRequest packet serialize failed");
-            std::unique_lock<std::mutex> lock(event_cb_mux_);
-            event_cb_pctxs_.emplace_back(std::make_shared<EventCBContext>(
-                PS_CB_TYPE_JOIN_GROUP, PS_CB_EVENT_REQ_ENC_FAILED,
-                "inner rejoin group: JoinGroupRequest packet serialize "
-                "failed. you "
-                "should rejoin all group manually"));
-            event_cb_cond_.notify_one();
+            post_event(PS_CB_TYPE_JOIN_GROUP, PS_CB_EVENT_REQ_ENC_FAILED,
+                       "inner rejoin group: JoinGroupRequest packet serialize "
+                       "failed. you should rejoin all group manually");
         }
         return;
     }
@@ -593,6 +757,74 @@ void PushSDK::rejoin_group(bool need_to_lock)
          need_to_lock);
 }
 
+void PushSDK::schedule_retry(PushSDKCBType type)
+{
+    std::unique_ptr<RetryPolicy>& policy =
+        type == PS_CB_TYPE_LOGIN ? relogin_policy_ : rejoin_policy_;
+
+    int64_t backoff = policy->NextBackoffMs();
+    if (backoff < 0) {
+        handle_retry_exhausted(type);
+        return;
+    }
+
+    log_w("{} retry after {}ms. attempts={}",
+          type == PS_CB_TYPE_LOGIN ? "relogin" : "rejoin group", backoff,
+          policy->Attempts());
+
+    std::unique_lock<std::mutex> lock(cb_map_mux_);
+    int64_t ts = Utils::GetSteadyNanoSeconds() + backoff * 1000000LL;
+    if (type == PS_CB_TYPE_LOGIN) {
+        relogin_retry_ts_ = ts;
+    }
+    else {
+        rejoin_retry_ts_ = ts;
+    }
+    lock.unlock();
+    SessionManager::Instance()->ScheduleTimer(shared_from_this(), ts);
+}
+
+void PushSDK::cancel_all_retries()
+{
+    std::unique_lock<std::mutex> lock(cb_map_mux_);
+    relogin_retry_ts_ = 0;
+    rejoin_retry_ts_  = 0;
+}
+
+void PushSDK::handle_retry_exhausted(PushSDKCBType type)
+{
+    std::unique_lock<std::mutex> user_lock(user_mux_);
+    if (!user_) {
+        return;
+    }
+
+    if (type == PS_CB_TYPE_LOGIN) {
+        log_e("relogin retry budget exhausted");
+        logining_ = false;
+        remove_all_group_info();
+        user_ = nullptr;
+        user_lock.unlock();
+
+        ELK_UPLOAD(appid_, uid_, suid_, "", "ReLogin", PS_RET_CALL_TIMEOUT,
+                   "inner relogin: retry budget exhausted");
+        post_terminal_event(TERMINAL_RELOGIN_EXHAUSTED);
+    }
+    else {
+        std::string dump_str = dump_all_group_info();
+        log_e("rejoin group retry budget exhausted");
+        if (dump_str != "") {
+            log_w("remove all group infos. dump={}", dump_str);
+        }
+        remove_all_group_info();
+        user_lock.unlock();
+
+        ELK_UPLOAD(appid_, uid_, suid_, dump_str, "ReJoinGroup",
+                   PS_RET_CALL_TIMEOUT,
+                   "inner rejoin group: retry budget exhausted");
+        post_terminal_event(TERMINAL_REJOIN_EXHAUSTED);
+    }
+}
+
 bool PushSDK::is_group_info_exists(uint64_t gtype, uint64_t gid)
 {
     auto sit = groups_.equal_range(gtype);
@@ -624,6 +856,14 @@ std::string PushSDK::dump_group_info(const PushSDKGroupInfo& info)
            ">";
 }
 
+int64_t PushSDK::get_call_deadline(int64_t now, int timeout_ms)
+{
+    if (timeout_ms <= 0) {
+        timeout_ms = Config::Instance()->call_timeout_interval;
+    }
+    return now + timeout_ms * 1000000LL;
+}
+
 std::string PushSDK::dump_all_group_info()
 {
     if (groups_.empty()) {
@@ -655,7 +895,8 @@ void PushSDK::call(PushSDKCBType               type,
                    uint64_t                    gtype,
                    uint64_t                    gid,
                    bool                        is_retry,
-                   bool                        need_to_lock)
+                   bool                        need_to_lock,
+                   int                         timeout_ms)
 {
     std::shared_ptr<CallContext> ctx = std::make_shared<CallContext>();
     ctx->cb_func                     = cb_func;
@@ -664,6 +905,7 @@ void PushSDK::call(PushSDKCBType               type,
     ctx->gtype                       = gtype;
     ctx->gid                         = gid;
     ctx->is_retry                    = is_retry;
+    ctx->deadline                    = get_call_deadline(now, timeout_ms);
 
     if (need_to_lock) {
         cb_map_mux_.lock();
@@ -673,14 +915,18 @@ void PushSDK::call(PushSDKCBType               type,
     else {
         cb_map_[now] = ctx;
     }
-    client_->Send(msg);
+    // 加入超时检测堆，到期时只检测该会话
+    SessionManager::Instance()->ScheduleTimer(shared_from_this(),
+                                              ctx->deadline);
+    client_->Send(session_, msg);
 }
 
 int PushSDK::call_sync(PushSDKCBType               type,
                        std::shared_ptr<PushRegReq> msg,
                        int64_t                     now,
                        uint64_t                    gtype,
-                       uint64_t                    gid)
+                       uint64_t                    gid,
+                       int                         timeout_ms)
 {
     std::shared_ptr<CallContext> ctx = std::make_shared<CallContext>();
     ctx->cb_func                     = nullptr;
@@ -689,19 +935,22 @@ int PushSDK::call_sync(PushSDKCBType               type,
     ctx->gtype                       = gtype;
     ctx->gid                         = gid;
     ctx->is_retry                    = false;
+    ctx->deadline                    = get_call_deadline(now, timeout_ms);
 
     cb_map_mux_.lock();
     cb_map_[now] = ctx;
     cb_map_mux_.unlock();
+    SessionManager::Instance()->ScheduleTimer(shared_from_this(),
+                                              ctx->deadline);
 
-    client_->Send(msg);
+    client_->Send(session_, msg);
 
     {
+        // 正常情况下由超时检测线程或取消调用唤醒，这里只做兜底
         std::unique_lock<std::mutex> lock(ctx->mux);
         if (!ctx->call_done) {
             ctx->cond.wait_for(
-                lock, std::chrono::milliseconds(
-                          Config::Instance()->call_timeout_interval * 2));
+                lock, std::chrono::nanoseconds((ctx->deadline - now) * 2));
         }
     }
 
@@ -716,18 +965,38 @@ int PushSDK::call_sync(PushSDKCBType               type,
         if (ctx->res == PS_CB_EVENT_TIMEOUT) {
             return PS_RET_CALL_TIMEOUT;
         }
+        else if (ctx->res == PS_CB_EVENT_CANCELED) {
+            return PS_RET_CALL_CANCELED;
+        }
         return PS_RET_CALL_FAILED;
     }
 }
 
 void PushSDK::notify(std::shared_ptr<CallContext> ctx,
                      PushSDKCBEvent               res,
-                     const std::string&           desc,
+                     const char*                  desc,
+                     int                          code)
+{
+    if (!ctx->cb_func && !ctx->cb_args) {
+        notify(ctx, res, desc, strlen(desc), code);
+    }
+    else if (ctx->cb_func == event_cb_) {
+        post_event(ctx->type, res, desc);
+    }
+    else {
+        ctx->cb_func(ctx->type, res, desc, ctx->cb_args);
+    }
+}
+
+void PushSDK::notify(std::shared_ptr<CallContext> ctx,
+                     PushSDKCBEvent               res,
+                     const char*                  desc,
+                     size_t                       len,
                      int                          code)
 {
     if (!ctx->cb_func && !ctx->cb_args) {
-        ctx->res  = res;
-        ctx->desc = desc;
+        ctx->res = res;
+        ctx->desc.assign(desc, len);
         ctx->code = code;
         ctx->mux.lock();
         ctx->call_done = true;
@@ -736,17 +1005,91 @@ void PushSDK::notify(std::shared_ptr<CallContext> ctx,
     }
     else {
         if (ctx->cb_func == event_cb_) {
-            std::unique_lock<std::mutex> lock(event_cb_mux_);
-            event_cb_pctxs_.emplace_back(
-                std::make_shared<EventCBContext>(ctx->type, res, desc));
-            event_cb_cond_.notify_one();
+            post_event(ctx->type, res, desc, len);
         }
         else {
-            ctx->cb_func(ctx->type, res, desc.c_str(), ctx->cb_args);
+            ctx->cb_func(ctx->type, res, desc, ctx->cb_args);
         }
     }
 }
 
+void PushSDK::post_event(PushSDKCBType  type,
+                         PushSDKCBEvent res,
+                         const char*    desc)
+{
+    EventCBContext ev;
+    ev.type = type;
+    ev.res  = res;
+    ev.desc = desc;
+    push_event(ev);
+}
+
+void PushSDK::post_event(PushSDKCBType  type,
+                         PushSDKCBEvent res,
+                         const char*    desc,
+                         size_t         len)
+{
+    EventCBContext ev;
+    ev.type = type;
+    ev.res  = res;
+    if (len >= sizeof(ev.short_desc)) {
+        ev.text = TextPool::Instance()->Put(desc, len);
+    }
+    if (ev.text < 0) {
+        // 共享缓冲用完时截断
+        len = std::min(len, sizeof(ev.short_desc) - 1);
+        memcpy(ev.short_desc, desc, len);
+        ev.short_desc[len] = '\0';
+    }
+    push_event(ev);
+}
+
+void PushSDK::post_terminal_event(TerminalEvent terminal)
+{
+    EventCBContext ev;
+    ev.type = TERMINAL_EVENTS[terminal].type;
+    ev.res  = TERMINAL_EVENTS[terminal].res;
+    ev.desc = TERMINAL_EVENTS[terminal].desc;
+    push_event(ev, terminal);
+}
+
+void PushSDK::push_event(const EventCBContext& ev, int terminal)
+{
+    bool ok = event_ring_.Push([&ev](EventCBContext& ctx) { ctx = ev; });
+    if (!ok && terminal >= 0) {
+        // 被踢下线、重试次数用完等事件不能丢弃，同类事件合并为一次回调
+        terminal_events_.fetch_or(1u << terminal);
+        log_w("event queue full, coalesce event. type={}, res={}", ev.type,
+              ev.res);
+    }
+    else if (!ok) {
+        event_drops_++;
+        log_w("event queue full, drop event. type={}, res={}, desc={}",
+              ev.type, ev.res, event_desc(ev));
+        release_event(ev);
+        return;
+    }
+
+    if (!event_pending_.exchange(true)) {
+        SessionManager::Instance()->NotifyEvent(this);
+    }
+}
+
+const char* PushSDK::event_desc(const EventCBContext& ev)
+{
+    if (ev.text >= 0) {
+        return TextPool::Instance()->Get(ev.text);
+    }
+    return ev.desc ? ev.desc : ev.short_desc;
+}
+
+void PushSDK::release_event(const EventCBContext& ev)
+{
+    if (ev.text >= 0) {
+        TextPool::Instance()->Release(ev.text);
+    }
+}
+
 void PushSDK::handle_notify_to_close()
 {
     std::unique_lock<std::mutex> user_lock(user_mux_);
@@ -758,13 +1101,7 @@ void PushSDK::handle_notify_to_close()
     remove_all_group_info();
     user_lock.unlock();
 
-    {
-        std::unique_lock<std::mutex> lock(event_cb_mux_);
-        event_cb_pctxs_.emplace_back(std::make_shared<EventCBContext>(
-            PS_CB_TYPE_LOGIN, PS_CB_EVENT_USER_KICKED_BY_SRV,
-            "user be kicked by the server"));
-        event_cb_cond_.notify_one();
-    }
+    post_terminal_event(TERMINAL_KICKED);
 }
 
 void PushSDK::handle_group_message(std::shared_ptr<PushData> msg)
@@ -772,8 +1109,8 @@ void PushSDK::handle_group_message(std::shared_ptr<PushData> msg)
     std::unique_lock<std::mutex> user_lock(user_mux_);
     if (!is_group_info_exists(msg->grouptype(), msg->groupid())) {
         // 用户已经退组，由于网络原因服务器没收到，这里再次向服务器发送退组信息
-        client_->Send(
-            make_leave_group_packet(uid_, msg->grouptype(), msg->groupid(), 0));
+        client_->Send(session_, make_leave_group_packet(uid_, msg->grouptype(),
+                                                        msg->groupid(), 0));
         return;
     }
 
@@ -793,7 +1130,8 @@ void PushSDK::handle_user_message(std::shared_ptr<PushData> msg)
     std::unique_lock<std::mutex> user_lock(user_mux_);
     if (!user_) {
         // 用户已经登出，由于网络原因服务器没收到，这里再次向服务器发送登出信息
-        client_->Send(make_logout_packet(uid_, appid_, appkey_, 0));
+        client_->Send(session_,
+                      make_logout_packet(uid_, appid_, appkey_, 0));
         return;
     }
     user_lock.unlock();
@@ -812,7 +1150,7 @@ void PushSDK::handle_timeout_response(std::shared_ptr<CallContext> ctx)
         case PS_CB_TYPE_LOGIN: {
             log_w("login timeout");
             if (ctx->is_retry) {
-                relogin(false, true);
+                schedule_retry(PS_CB_TYPE_LOGIN);
             }
             break;
         }
@@ -820,7 +1158,7 @@ void PushSDK::handle_timeout_response(std::shared_ptr<CallContext> ctx)
         case PS_CB_TYPE_JOIN_GROUP: {
             log_w("join group timeout");
             if (ctx->is_retry) {
-                rejoin_group(false);
+                schedule_retry(PS_CB_TYPE_JOIN_GROUP);
             }
             break;
         }
@@ -837,4 +1175,42 @@ void PushSDK::handle_timeout_response(std::shared_ptr<CallContext> ctx)
         default: break;
     }
 }
+
+void PushSDK::handle_canceled_response(std::shared_ptr<CallContext> ctx)
+{
+    switch (ctx->type) {
+        case PS_CB_TYPE_LOGIN: {
+            // 取消登录，与登录失败一样清理登录信息
+            log_w("login canceled");
+            logining_ = false;
+            user_mux_.lock();
+            remove_all_group_info();
+            user_ = nullptr;
+            user_mux_.unlock();
+            break;
+        }
+
+        case PS_CB_TYPE_JOIN_GROUP: {
+            // 取消进组，清理组信息，允许再次进组
+            log_w("join group canceled. gtype={}, gid={}", ctx->gtype,
+                  ctx->gid);
+            user_mux_.lock();
+            remove_group_info(ctx->gtype, ctx->gid);
+            user_mux_.unlock();
+            break;
+        }
+
+        case PS_CB_TYPE_LOGOUT: {
+            log_w("logout canceled");
+            break;
+        }
+
+        case PS_CB_TYPE_LEAVE_GROUP: {
+            log_w("leave group canceled. gtype={}, gid={}", ctx->gtype,
+                  ctx->gid);
+            break;
+        }
+        default: break;
+    }
+}
 }  // namespace edu
\ No newline at end of file
@@ -2,26 +2,35 @@
 #define EDU_PUSH_SDK_CORE_H
 
 #include <common/err_code.h>
+#include <common/mpsc_ring.h>
+#include <common/retry_policy.h>
 #include <common/singleton.h>
+#include <common/text_pool.h>
 #include <core/client.h>
 #include <elk/async_upload.h>
 #include <push_sdk.h>
 
 #include <condition_variable>
 #include <memory>
+#include <set>
 #include <sstream>
 
 namespace edu {
 
+class PushSDK;
+
 struct Handler
 {
     Handler()
     {
+        owner         = nullptr;
         user_msg_cb   = nullptr;
         group_msg_cb  = nullptr;
         conn_state_cb = nullptr;
     }
 
+    // 创建该句柄的会话
+    PushSDK*           owner;
     PushSDKUserMsgCB   user_msg_cb;
     PushSDKGroupMsgCB  group_msg_cb;
     PushSDKConnStateCB conn_state_cb;
@@ -44,6 +53,8 @@ struct CallContext
     uint64_t gtype;
     uint64_t gid;
     bool     is_retry;
+    // 超时时间点(ns)
+    int64_t deadline;
 
     // 同步接口使用
     std::mutex              mux;
@@ -60,6 +71,7 @@ class PushSDK : public Singleton<PushSDK>,
                 public MessageHandler,
                 public std::enable_shared_from_this<PushSDK> {
     friend class Singleton<PushSDK>;
+    friend class SessionManager;
 
   public:
     virtual ~PushSDK();
@@ -68,47 +80,68 @@ class PushSDK : public Singleton<PushSDK>,
     PushSDK();
 
   public:
+    // 创建独立于全局实例的会话，多个会话共享连接及SDK内部线程
+    static std::shared_ptr<PushSDK> CreateSession();
+
     virtual int  Initialize(uint32_t       uid,
                             uint64_t       appid,
                             uint64_t       appkey,
                             PushSDKEventCB cb_func,
                             void*          cb_args);
-    virtual void Destroy();
+    // 不能在SDK内部线程中调用，否则返回PS_RET_IN_SDK_THREAD
+    virtual int Destroy();
     virtual int  Login(const PushSDKUserInfo& user,
-                       bool                   is_sync = true,
-                       PushSDKEventCB         cb_func = nullptr,
-                       void*                  cb_args = nullptr);
-
-    virtual int Logout(bool           is_sync = true,
-                       PushSDKEventCB cb_func = nullptr,
-                       void*          cb_args = nullptr);
+                       bool                   is_sync    = true,
+                       PushSDKEventCB         cb_func    = nullptr,
+                       void*                  cb_args    = nullptr,
+                       int                    timeout_ms = 0);
+
+    virtual int Logout(bool           is_sync    = true,
+                       PushSDKEventCB cb_func    = nullptr,
+                       void*          cb_args    = nullptr,
+                       int            timeout_ms = 0);
     virtual int JoinGroup(const PushSDKGroupInfo& group,
-                          bool                    is_sync = true,
-                          PushSDKEventCB          cb_func = nullptr,
-                          void*                   cb_args = nullptr);
+                          bool                    is_sync    = true,
+                          PushSDKEventCB          cb_func    = nullptr,
+                          void*                   cb_args    = nullptr,
+                          int                     timeout_ms = 0);
     virtual int LeaveGroup(const PushSDKGroupInfo& group,
-                           bool                    is_sync = true,
-                           PushSDKEventCB          cb_func = nullptr,
-                           void*                   cb_args = nullptr);
+                           bool                    is_sync    = true,
+                           PushSDKEventCB          cb_func    = nullptr,
+                           void*                   cb_args    = nullptr,
+                           int                     timeout_ms = 0);
+
+    virtual void CancelCall(PushSDKCBType           type,
+                            const PushSDKGroupInfo* group = nullptr);
 
     virtual void GetLastError(std::string& desc, int& code);
+    virtual void GetAppInfo(uint64_t& appid, uint64_t& appkey);
+    virtual void GetStats(PushSDKStats& stats);
 
     virtual Handler* CreateHandler();
-    virtual void     DestroyHandler(Handler* hdl);
-    virtual void     AddUserMsgCBToHandler(Handler* hdl, PushSDKUserMsgCB cb);
-    virtual void     AddGroupMsgCBToHandler(Handler* hdl, PushSDKGroupMsgCB cb);
-    virtual void AddConnStateCBToHandler(Handler* hdl, PushSDKConnStateCB cb);
+    // 以下函数先在全局句柄表中校验句柄，已销毁或无效的句柄直接忽略
+    static void DestroyHandler(Handler* hdl);
+    static void AddUserMsgCBToHandler(Handler* hdl, PushSDKUserMsgCB cb);
+    static void AddGroupMsgCBToHandler(Handler* hdl, PushSDKGroupMsgCB cb);
+    static void AddConnStateCBToHandler(Handler* hdl, PushSDKConnStateCB cb);
 
     virtual void NotifyChannelState(ChannelState state) override;
     virtual void OnConnected() override;
     virtual void OnMessage(std::shared_ptr<PushData> msg) override;
 
+    // 由超时检测线程调用，处理超时的调用及到期的重试，
+    // 返回下次需要检测的时间(ns)，没有未完成的调用和重试时返回0
+    virtual int64_t CheckCalls(int64_t now);
+    // 由事件回调线程调用，回调该会话所有待处理的事件
+    virtual void DispatchEvents();
+
   private:
     bool               is_group_info_exists(uint64_t gtype, uint64_t gid);
     void               remove_group_info(uint64_t gtype, uint64_t gid);
     std::string        dump_all_group_info();
     void               remove_all_group_info();
     static std::string dump_group_info(const PushSDKGroupInfo& info);
+    static int64_t     get_call_deadline(int64_t now, int timeout_ms);
 
     void call(PushSDKCBType               type,
               std::shared_ptr<PushRegReq> msg,
@@ -118,22 +151,42 @@ class PushSDK : public Singleton<PushSDK>,
               uint64_t                    gtype        = 0,
               uint64_t                    gid          = 0,
               bool                        is_retry     = false,
-              bool                        need_to_lock = true);
+              bool                        need_to_lock = true,
+              int                         timeout_ms   = 0);
 
     int  call_sync(PushSDKCBType               type,
                    std::shared_ptr<PushRegReq> msg,
                    int64_t                     now,
-                   uint64_t                    gtype = 0,
-                   uint64_t                    gid   = 0);
+                   uint64_t                    gtype      = 0,
+                   uint64_t                    gid        = 0,
+                   int                         timeout_ms = 0);
+    // desc必须是字符串常量
+    void notify(std::shared_ptr<CallContext> ctx,
+                PushSDKCBEvent               res,
+                const char*                  desc,
+                int                          code);
+    // desc为以'\0'结尾的len字节字符串，如服务器返回的错误信息，投递事件时拷贝
     void notify(std::shared_ptr<CallContext> ctx,
                 PushSDKCBEvent               res,
-                const std::string&           desc,
+                const char*                  desc,
+                size_t                       len,
                 int                          code);
+    // desc必须是字符串常量，槽位中只保存指针
+    void post_event(PushSDKCBType type, PushSDKCBEvent res, const char* desc);
+    void post_event(PushSDKCBType  type,
+                    PushSDKCBEvent res,
+                    const char*    desc,
+                    size_t         len);
 
     void relogin(bool need_to_lock = true, bool is_timeout = false);
     void rejoin_group(bool need_to_lock = true);
+    void schedule_retry(PushSDKCBType type);
+    void cancel_all_retries();
+    void destroy_handlers();
+    void handle_retry_exhausted(PushSDKCBType type);
 
     void handle_timeout_response(std::shared_ptr<CallContext> ctx);
+    void handle_canceled_response(std::shared_ptr<CallContext> ctx);
     void handle_notify_to_close();
     void handle_group_message(std::shared_ptr<PushData> msg);
     void handle_user_message(std::shared_ptr<PushData> msg);
@@ -197,6 +250,7 @@ class PushSDK : public Singleton<PushSDK>,
             log_i("login successfully");
             // 清除正在登录状态
             logining_ = false;
+            relogin_policy_->Reset();
             // 重新进组
             if (ctx->is_retry) {
                 rejoin_group();
@@ -208,6 +262,7 @@ class PushSDK : public Singleton<PushSDK>,
         else if (std::is_same<T, JoinGroupResponse>::value) {
             if (ctx->gtype == 0 && ctx->gid == 0) {
                 //全量进组
+                rejoin_policy_->Reset();
                 std::string dump_str = dump_all_group_info();
                 if (dump_str != "") {
                     log_i("join group successfully. dump={}", dump_str);
@@ -232,13 +287,8 @@ class PushSDK : public Singleton<PushSDK>,
         T res;
         if (!res.ParseFromString(msg->msgdata())) {
             log_e("decode packet failed");
-            {
-                std::unique_lock<std::mutex> lock(event_cb_mux_);
-                event_cb_pctxs_.emplace_back(std::make_shared<EventCBContext>(
-                    PS_CB_TYPE_INNER_ERR, PS_CB_EVENT_RES_DEC_FAILED,
-                    "decode packet failed"));
-                event_cb_cond_.notify_one();
-            }
+            post_event(PS_CB_TYPE_INNER_ERR, PS_CB_EVENT_RES_DEC_FAILED,
+                       "decode packet failed");
             return;
         }
 
@@ -263,7 +313,7 @@ class PushSDK : public Singleton<PushSDK>,
         if (res.rescode() != RES_SUCCESS) {
             handle_failed_response<T>(res, ctx);
             notify(ctx, PS_CB_EVENT_FAILED, res.errmsg().c_str(),
-                   res.rescode());
+                   res.errmsg().size(), res.rescode());
         }
         else {
             handle_success_response<T>(ctx);
@@ -272,53 +322,84 @@ class PushSDK : public Singleton<PushSDK>,
     }
 
   private:
+    // 字符串常量描述只保存指针，其他描述较短时拷贝到槽位内，
+    // 较长的(如服务器返回的错误信息)放到共享的TextPool中，槽位只保存编号
     struct EventCBContext
     {
-        EventCBContext(PushSDKCBType     type,
-                       PushSDKCBEvent    res,
-                       const std::string desc)
+        EventCBContext()
         {
-            this->type = type;
-            this->res  = res;
-            this->desc = desc;
+            type          = PS_CB_TYPE_INNER_ERR;
+            res           = PS_CB_EVENT_OK;
+            desc          = nullptr;
+            text          = -1;
+            short_desc[0] = '\0';
         }
         PushSDKCBType  type;
         PushSDKCBEvent res;
-        std::string    desc;
+        const char*    desc;
+        int            text;
+        char           short_desc[40];
     };
 
-  private:
-    bool                    init_;
-    uint32_t                uid_;
-    uint64_t                suid_;
-    uint64_t                appid_;
-    uint64_t                appkey_;
-    PushSDKEventCB          event_cb_;
-    void*                   event_cb_arg_;
-    std::shared_ptr<Client> client_;
-    bool                    logining_;
-    std::string             desc_;
-    int                     code_;
+    // 队列满时也不能丢弃的事件，入队失败时按种类合并记录到terminal_events_，
+    // 事件回调线程取完队列后补发
+    enum TerminalEvent {
+        TERMINAL_KICKED            = 0,
+        TERMINAL_RELOGIN_EXHAUSTED = 1,
+        TERMINAL_REJOIN_EXHAUSTED  = 2,
+        TERMINAL_EVENT_COUNT       = 3
+    };
 
+    void        post_terminal_event(TerminalEvent terminal);
+    void        push_event(const EventCBContext& ev, int terminal = -1);
+    void        dispatch_event(const EventCBContext& ev);
+    const char* event_desc(const EventCBContext& ev);
+    void        release_event(const EventCBContext& ev);
+
+  private:
+    bool                           init_;
+    uint32_t                       uid_;
+    uint64_t                       suid_;
+    uint64_t                       appid_;
+    uint64_t                       appkey_;
+    PushSDKEventCB                 event_cb_;
+    void*                          event_cb_arg_;
+    std::shared_ptr<Client>        client_;
+    std::shared_ptr<ClientSession> session_;
+    bool                           logining_;
+    std::string                    desc_;
+    int                            code_;
+
+    // 该会话创建的句柄，会话销毁时一起销毁
     std::vector<Handler*> hdls_;
     std::mutex            hdls_mux_;
+    // 所有会话的有效句柄，先加live_hdls_mux_再加hdls_mux_
+    static std::set<Handler*> live_hdls_;
+    static std::mutex         live_hdls_mux_;
 
     std::unique_ptr<PushSDKUserInfo>  user_;
     std::multimap<uint64_t, uint64_t> groups_;
     std::mutex                        user_mux_;
 
-    std::unique_ptr<std::thread>                    cb_map_thread_;
     std::map<int64_t, std::shared_ptr<CallContext>> cb_map_;
-    std::condition_variable                         cb_map_cond_;
     std::mutex                                      cb_map_mux_;
-    bool                                            cb_map_thread_quit_flag_;
-
-    std::unique_ptr<std::thread>                event_cb_thread_;
-    std::deque<std::shared_ptr<EventCBContext>> event_cb_pctxs_;
-    std::condition_variable                     event_cb_cond_;
-    std::mutex                                  event_cb_mux_;
-    std::thread::id                             event_cb_thread_id_;
-    bool                                        event_cb_thread_quit_flag_;
+
+    // 重登、重新进组的退避重试，时间点(ns)由cb_map_mux_保护，0为无待执行重试
+    std::unique_ptr<RetryPolicy> relogin_policy_;
+    std::unique_ptr<RetryPolicy> rejoin_policy_;
+    int64_t                      relogin_retry_ts_;
+    int64_t                      rejoin_retry_ts_;
+
+    // 待回调的事件，事件回调线程是唯一的消费者。event_pending_为true时
+    // 会话已在事件回调线程的队列中，不再重复通知
+    MpscRing<EventCBContext, 16> event_ring_;
+    std::atomic<uint32_t>        terminal_events_;
+    std::atomic<bool>            event_pending_;
+    std::atomic<uint64_t>        event_drops_;
+    // 事件回调线程队列中的下一个会话及会话是否仍可入队，
+    // 由SessionManager::event_cb_mux_保护
+    PushSDK* event_next_;
+    bool     event_queueable_;
 };
 
 }  // namespace edu
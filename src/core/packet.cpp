@@ -143,6 +143,27 @@ make_join_group_packet(uint32_t                                 uid,
     return req;
 }
 
+std::shared_ptr<PushRegReq> make_ping_packet(uint32_t uid, int64_t now)
+{
+    PingRequest ping_req;
+    ping_req.set_uid(uid);
+    ping_req.set_suid(Utils::GetSUID(uid, get_user_terminal_type()));
+    // 发送时间(ns)，服务器在Pong中原样带回，用于计算RTT
+    ping_req.set_context(std::to_string(now));
+
+    std::string msg_data;
+    if (!ping_req.SerializeToString(&msg_data)) {
+        log_e("PingRequest packet serialize failed");
+        return nullptr;
+    }
+
+    std::shared_ptr<PushRegReq> req = std::make_shared<PushRegReq>();
+    req->set_uri(StreamURI::PPushGateWayPingURI);
+    req->set_msgdata(msg_data);
+
+    return req;
+}
+
 std::shared_ptr<PushRegReq>
 make_leave_group_packet(uint32_t uid, uint64_t gtype, uint64_t gid, int64_t now)
 {
@@ -29,6 +29,8 @@ extern std::shared_ptr<PushRegReq> make_leave_group_packet(uint32_t uid,
                                                            uint64_t gid,
                                                            int64_t  now);
 
+extern std::shared_ptr<PushRegReq> make_ping_packet(uint32_t uid, int64_t now);
+
 extern UserTerminalType get_user_terminal_type();
 }  // namespace edu
 #endif
\ No newline at end of file
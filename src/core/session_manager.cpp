@@ -0,0 +1,324 @@
+#include <common/config.h>
+#include <common/dns_cache.h>
+#include <common/log.h>
+#include <common/utils.h>
+#include <core/core.h>
+#include <core/session_manager.h>
+
+#include <algorithm>
+
+namespace edu {
+
+SessionManager::SessionManager()
+{
+    init_ = false;
+
+    timer_thread_           = nullptr;
+    timer_thread_quit_flag_ = true;
+
+    event_cb_thread_           = nullptr;
+    event_cb_thread_quit_flag_ = true;
+    event_head_                = nullptr;
+    event_tail_                = nullptr;
+}
+
+SessionManager::~SessionManager()
+{
+    Destroy();
+}
+
+int SessionManager::Initialize()
+{
+    int ret = PS_RET_SUCCESS;
+
+    if (init_) {
+        return ret;
+    }
+
+    // 域名在首次连接时加入缓存，之后在后台按TTL刷新
+    DnsCache::Instance()->Initialize();
+
+    int pool_size = std::max(1, Config::Instance()->grpc_client_pool_size);
+    for (int i = 0; i < pool_size; i++) {
+        std::shared_ptr<Client> client = std::make_shared<Client>(i);
+        if ((ret = client->Initialize()) != PS_RET_SUCCESS) {
+            log_e("client initialize failed. ret={}", ret);
+            for (std::shared_ptr<Client>& c : clients_) {
+                c->Destroy();
+            }
+            clients_.clear();
+            DnsCache::Instance()->Destroy();
+            return ret;
+        }
+        clients_.push_back(client);
+    }
+
+    timer_thread_quit_flag_ = false;
+    timer_thread_ = std::unique_ptr<std::thread>(new std::thread([this]() {
+        std::vector<std::weak_ptr<PushSDK>> due;
+        std::set<PushSDK*>                  checked;
+
+        while (!timer_thread_quit_flag_) {
+            int64_t now = 0;
+            {
+                // 等到堆顶到期，堆为空时最多等待call_check_timeout_interval
+                std::unique_lock<std::mutex> lock(timer_wake_mux_);
+                now          = Utils::GetSteadyNanoSeconds();
+                int64_t wait = Config::Instance()->call_check_timeout_interval;
+                if (!timers_.empty()) {
+                    wait = std::min<int64_t>(
+                        wait, Utils::NanoSecondsToMilliSeconds(
+                                  timers_.top().deadline - now + 999999));
+                }
+                if (wait > 0 && !timer_thread_quit_flag_) {
+                    timer_cond_.wait_for(lock, std::chrono::milliseconds(wait));
+                }
+                if (timer_thread_quit_flag_) {
+                    return;
+                }
+
+                now = Utils::GetSteadyNanoSeconds();
+                while (!timers_.empty() && timers_.top().deadline <= now) {
+                    due.push_back(timers_.top().sdk);
+                    timers_.pop();
+                }
+            }
+
+            // 只检测到期的会话，会话返回自己下次需要检测的时间
+            {
+                std::unique_lock<std::mutex> lock(timer_mux_);
+                for (std::weak_ptr<PushSDK>& weak : due) {
+                    std::shared_ptr<PushSDK> sdk = weak.lock();
+                    if (!sdk || !timer_sessions_.count(sdk.get()) ||
+                        !checked.insert(sdk.get()).second) {
+                        continue;
+                    }
+                    int64_t next = sdk->CheckCalls(now);
+                    if (next != 0) {
+                        ScheduleTimer(sdk, next);
+                    }
+                }
+            }
+            due.clear();
+            checked.clear();
+        }
+    }));
+    timer_thread_id_ = timer_thread_->get_id();
+
+    event_cb_thread_quit_flag_ = false;
+    event_cb_thread_ = std::unique_ptr<std::thread>(new std::thread([this]() {
+        while (!event_cb_thread_quit_flag_) {
+            std::unique_lock<std::mutex> lock(event_cb_mux_);
+            if (!event_head_ && !event_cb_thread_quit_flag_) {
+                event_cb_cond_.wait(lock);
+            }
+            if (!event_head_) {
+                continue;
+            }
+
+            PushSDK* sdk = event_head_;
+            event_head_  = sdk->event_next_;
+            if (!event_head_) {
+                event_tail_ = nullptr;
+            }
+            sdk->event_next_ = nullptr;
+
+            std::unique_lock<std::mutex> dispatch_lock(event_dispatch_mux_);
+            lock.unlock();
+            sdk->DispatchEvents();
+        }
+    }));
+    event_cb_thread_id_ = event_cb_thread_->get_id();
+
+    init_ = true;
+
+    return ret;
+}
+
+void SessionManager::Destroy()
+{
+    if (!init_) {
+        return;
+    }
+
+    // 销毁用户未销毁的会话
+    sessions_mux_.lock();
+    std::vector<std::shared_ptr<PushSDK>> sessions = sessions_;
+    sessions_mux_.unlock();
+    for (std::shared_ptr<PushSDK>& sdk : sessions) {
+        sdk->Destroy();
+    }
+    sessions.clear();
+
+    event_cb_mux_.lock();
+    event_cb_thread_quit_flag_ = true;
+    event_cb_cond_.notify_all();
+    event_cb_mux_.unlock();
+
+    event_cb_thread_->join();
+    event_cb_thread_    = nullptr;
+    event_cb_thread_id_ = std::thread::id();
+
+    timer_wake_mux_.lock();
+    timer_thread_quit_flag_ = true;
+    timer_cond_.notify_all();
+    timer_wake_mux_.unlock();
+
+    timer_thread_->join();
+    timer_thread_    = nullptr;
+    timer_thread_id_ = std::thread::id();
+    timers_          = decltype(timers_)();
+    timer_sessions_.clear();
+
+    event_head_ = nullptr;
+    event_tail_ = nullptr;
+    sessions_.clear();
+
+    for (std::shared_ptr<Client>& client : clients_) {
+        client->Destroy();
+    }
+    clients_.clear();
+
+    DnsCache::Instance()->Destroy();
+
+    init_ = false;
+}
+
+std::shared_ptr<Client> SessionManager::GetClient(uint64_t suid)
+{
+    if (!init_ || clients_.empty()) {
+        return nullptr;
+    }
+
+    // suid低位为uid，高位为终端类型，混合后再取模，避免uid规律导致分布不均
+    uint64_t h = suid;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return clients_[h % clients_.size()];
+}
+
+void SessionManager::GetStats(PushSDKStats& stats)
+{
+    if (!init_) {
+        return;
+    }
+
+    stats.conn_count = static_cast<uint32_t>(
+        std::min<size_t>(clients_.size(), PS_MAX_CONN_STATS));
+    for (uint32_t i = 0; i < stats.conn_count; i++) {
+        PushSDKConnStats& conn = stats.conns[i];
+        conn.streams           = clients_[i]->GetSessionCount();
+        clients_[i]->GetTraffic(conn.msgs_sent, conn.bytes_sent,
+                                conn.msgs_recv, conn.bytes_recv);
+    }
+
+    // 压缩统计为所有连接之和，压缩率约为compress_zip_bytes/compress_raw_bytes
+    for (std::shared_ptr<Client>& client : clients_) {
+        uint64_t msgs = 0, raw = 0, zip = 0;
+        client->GetCompression(msgs, raw, zip);
+        stats.compressed_msgs += msgs;
+        stats.compress_raw_bytes += raw;
+        stats.compress_zip_bytes += zip;
+    }
+}
+
+void SessionManager::AddSession(std::shared_ptr<PushSDK> sdk)
+{
+    sessions_mux_.lock();
+    sessions_.push_back(sdk);
+    sessions_mux_.unlock();
+
+    timer_mux_.lock();
+    timer_sessions_.insert(sdk.get());
+    timer_mux_.unlock();
+
+    event_cb_mux_.lock();
+    sdk->event_queueable_ = true;
+    event_cb_mux_.unlock();
+}
+
+void SessionManager::RemoveSession(PushSDK* sdk)
+{
+    auto match = [sdk](const std::shared_ptr<PushSDK>& s) {
+        return s.get() == sdk;
+    };
+
+    sessions_mux_.lock();
+    sessions_.erase(std::remove_if(sessions_.begin(), sessions_.end(), match),
+                    sessions_.end());
+    sessions_mux_.unlock();
+
+    // 移除后不再入队，之后投递的事件留在会话的队列中
+    event_cb_mux_.lock();
+    sdk->event_queueable_ = false;
+    PushSDK* prev         = nullptr;
+    for (PushSDK* p = event_head_; p; prev = p, p = p->event_next_) {
+        if (p != sdk) {
+            continue;
+        }
+        if (prev) {
+            prev->event_next_ = p->event_next_;
+        }
+        else {
+            event_head_ = p->event_next_;
+        }
+        if (event_tail_ == p) {
+            event_tail_ = prev;
+        }
+        p->event_next_ = nullptr;
+        break;
+    }
+    event_cb_mux_.unlock();
+
+    // 等待正在进行的超时检测和事件回调结束，堆中剩余的项到期后直接丢弃
+    timer_mux_.lock();
+    timer_sessions_.erase(sdk);
+    timer_mux_.unlock();
+    event_dispatch_mux_.lock();
+    event_dispatch_mux_.unlock();
+}
+
+void SessionManager::ScheduleTimer(std::shared_ptr<PushSDK> sdk,
+                                   int64_t                  deadline)
+{
+    SessionTimer timer;
+    timer.deadline = deadline;
+    timer.sdk      = sdk;
+
+    std::unique_lock<std::mutex> lock(timer_wake_mux_);
+    bool earliest = timers_.empty() || deadline < timers_.top().deadline;
+    timers_.push(timer);
+    if (earliest) {
+        timer_cond_.notify_one();
+    }
+}
+
+void SessionManager::NotifyEvent(PushSDK* sdk)
+{
+    std::unique_lock<std::mutex> lock(event_cb_mux_);
+    // 调用方通过PushSDK::event_pending_保证会话不会重复入队
+    if (!sdk->event_queueable_) {
+        return;
+    }
+    sdk->event_next_ = nullptr;
+    if (event_tail_) {
+        event_tail_->event_next_ = sdk;
+    }
+    else {
+        event_head_ = sdk;
+    }
+    event_tail_ = sdk;
+    event_cb_cond_.notify_one();
+}
+
+bool SessionManager::IsInnerThread()
+{
+    std::thread::id id = std::this_thread::get_id();
+    return id == timer_thread_id_ || id == event_cb_thread_id_;
+}
+
+}  // namespace edu
\ No newline at end of file
@@ -0,0 +1,103 @@
+#ifndef EDU_PUSH_SDK_SESSION_MANAGER_H
+#define EDU_PUSH_SDK_SESSION_MANAGER_H
+
+#include <common/singleton.h>
+#include <core/client.h>
+#include <push_sdk.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace edu {
+
+class PushSDK;
+
+// 超时检测堆中的一项，会话可能已经销毁，只持有弱引用
+struct SessionTimer
+{
+    bool operator>(const SessionTimer& other) const
+    {
+        return deadline > other.deadline;
+    }
+
+    int64_t                deadline;
+    std::weak_ptr<PushSDK> sdk;
+};
+
+// 进程内所有会话共享的资源：连接(每个连接一个CQ线程)、调用超时及重试检测线程、
+// 全局事件回调线程。单个会话只保存自身的状态和一个stream
+class SessionManager : public Singleton<SessionManager> {
+    friend class Singleton<SessionManager>;
+
+  public:
+    virtual ~SessionManager();
+
+  protected:
+    SessionManager();
+
+  public:
+    virtual int  Initialize();
+    virtual void Destroy();
+
+    // 按suid哈希为会话分配连接，未初始化时返回空
+    virtual std::shared_ptr<Client> GetClient(uint64_t suid);
+    // 连接池中各连接的统计
+    virtual void GetStats(PushSDKStats& stats);
+
+    virtual void AddSession(std::shared_ptr<PushSDK> sdk);
+    // 返回后超时检测线程和事件回调线程不会再访问该会话
+    virtual void RemoveSession(PushSDK* sdk);
+
+    // 会话在deadline(ns)有调用超时或重试到期，加入超时检测堆，
+    // 早于当前最近的时间点时唤醒超时检测线程
+    virtual void ScheduleTimer(std::shared_ptr<PushSDK> sdk, int64_t deadline);
+    // 会话有待回调的事件，加入事件回调队列并唤醒事件回调线程，
+    // 队列通过PushSDK::event_next_串联，不分配内存
+    virtual void NotifyEvent(PushSDK* sdk);
+    // 当前线程是否为超时检测线程或事件回调线程
+    virtual bool IsInnerThread();
+
+  private:
+    bool init_;
+
+    std::vector<std::shared_ptr<Client>> clients_;
+
+    std::vector<std::shared_ptr<PushSDK>> sessions_;
+    std::mutex                            sessions_mux_;
+
+    // 检测过程中持有timer_mux_，移除会话时等待本轮检测结束，
+    // timer_sessions_为仍可检测的会话，由timer_mux_保护
+    std::unique_ptr<std::thread> timer_thread_;
+    std::thread::id              timer_thread_id_;
+    std::mutex                   timer_mux_;
+    std::set<PushSDK*>           timer_sessions_;
+    // 按到期时间排列的最小堆，每次只检测到期的会话，由timer_wake_mux_保护
+    std::priority_queue<SessionTimer,
+                        std::vector<SessionTimer>,
+                        std::greater<SessionTimer>>
+                            timers_;
+    std::mutex              timer_wake_mux_;
+    std::condition_variable timer_cond_;
+    bool                    timer_thread_quit_flag_;
+
+    // 回调过程中持有event_dispatch_mux_，移除会话时等待本次回调结束
+    // 取出会话时先加event_dispatch_mux_再释放event_cb_mux_，
+    // 保证RemoveSession返回后不会再回调已移出队列的会话
+    std::unique_ptr<std::thread> event_cb_thread_;
+    std::thread::id              event_cb_thread_id_;
+    PushSDK*                     event_head_;
+    PushSDK*                     event_tail_;
+    std::condition_variable      event_cb_cond_;
+    std::mutex                   event_cb_mux_;
+    std::mutex                   event_dispatch_mux_;
+    bool                         event_cb_thread_quit_flag_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
@@ -12,14 +12,15 @@
 
 namespace edu {
 
-Stream::Stream(std::shared_ptr<Client> client)
+Stream::Stream(std::shared_ptr<Client> client, ClientSession* session)
 {
-    client_ = client;
+    client_  = client;
+    session_ = session;
 
     ctx_ = std::unique_ptr<grpc::ClientContext>(new grpc::ClientContext);
-    // 填入header
-    ctx_->AddMetadata(HASH_HEADER_KEY, std::to_string(client->GetSUID()));
-    ctx_->AddMetadata(UID_HEADER_KEY, std::to_string(client->GetUID()));
+    // 填入header，每个会话使用自己的suid
+    ctx_->AddMetadata(HASH_HEADER_KEY, std::to_string(session->suid));
+    ctx_->AddMetadata(UID_HEADER_KEY, std::to_string(session->uid));
 
     push_data_   = std::unique_ptr<PushData>(new PushData);
     rw_          = nullptr;
@@ -37,33 +38,30 @@ void Stream::Init()
     status_ = StreamStatus::WAIT_CONNECT;
     log_t("WAIT_CONNECT");
 
-    rw_ = client_->stub->AsyncPushRegister(
-        ctx_.get(), client_->cq.get(),
-        reinterpret_cast<void*>(ClientEvent::CONNECTED));
+    rw_ = client_->stub->AsyncPushRegister(ctx_.get(), client_->cq.get(),
+                                           tag(ClientEvent::CONNECTED));
 }
 
 void Stream::Process(ClientEvent event, bool ok)
 {
     switch (event) {
         case ClientEvent::CONNECTED: {
-            rw_->Read(push_data_.get(),
-                      reinterpret_cast<void*>(ClientEvent::READ_DONE));
+            rw_->Read(push_data_.get(), tag(ClientEvent::READ_DONE));
             status_ = StreamStatus::READY_TO_WRITE;
 
             if (ok) {
                 log_t("CONNECTED");
-                client_->on_connected();
+                client_->on_connected(session_);
             }
             break;
         }
         case ClientEvent::READ_DONE: {
-            rw_->Read(push_data_.get(),
-                      reinterpret_cast<void*>(ClientEvent::READ_DONE));
+            rw_->Read(push_data_.get(), tag(ClientEvent::READ_DONE));
 
             log_t("READ_DONE");
             PushData*                 p = new PushData(*push_data_.get());
             std::shared_ptr<PushData> push_data(p);
-            client_->on_read(push_data);
+            client_->on_read(session_, push_data);
 
             break;
         }
@@ -74,10 +72,8 @@ void Stream::Process(ClientEvent event, bool ok)
             }
             else {
                 std::shared_ptr<PushRegReq> r = msg_queue_.front();
-                rw_->Write(*r,
-                           reinterpret_cast<void*>(ClientEvent::WRITE_DONE));
-                status_ = StreamStatus::WAIT_WRITE_DONE;
                 msg_queue_.pop_front();
+                write(r);
             }
             break;
         }
@@ -94,8 +90,7 @@ void Stream::Send(std::shared_ptr<PushRegReq> req)
     if (status_ == StreamStatus::READY_TO_WRITE) {
         std::shared_ptr<PushRegReq> r = msg_queue_.front();
         msg_queue_.pop_front();
-        rw_->Write(*r, reinterpret_cast<void*>(ClientEvent::WRITE_DONE));
-        status_ = StreamStatus::WAIT_WRITE_DONE;
+        write(r);
     }
 }
 
@@ -112,8 +107,31 @@ void Stream::SendMsgs(std::deque<std::shared_ptr<PushRegReq>>& msgs)
         }
         std::shared_ptr<PushRegReq> r = msg_queue_.front();
         msg_queue_.pop_front();
-        rw_->Write(*r, reinterpret_cast<void*>(ClientEvent::WRITE_DONE));
-        status_ = StreamStatus::WAIT_WRITE_DONE;
+        write(r);
+    }
+}
+
+void* Stream::tag(ClientEvent event)
+{
+    return make_client_tag(session_->slot, event);
+}
+
+void Stream::write(std::shared_ptr<PushRegReq> req)
+{
+    grpc::WriteOptions options;
+    // 未开启压缩或消息小于阈值时直接发送原始数据
+    if (!client_->on_write(req)) {
+        options.set_no_compression();
+    }
+
+    rw_->Write(*req, options, tag(ClientEvent::WRITE_DONE));
+    status_ = StreamStatus::WAIT_WRITE_DONE;
+}
+
+void Stream::Cancel()
+{
+    if (ctx_) {
+        ctx_->TryCancel();
     }
 }
 
@@ -121,6 +139,7 @@ void Stream::Destroy()
 {
     ctx_         = nullptr;
     client_      = nullptr;
+    session_     = nullptr;
     push_data_   = nullptr;
     rw_          = nullptr;
     status_      = StreamStatus::WAIT_CONNECT;
@@ -152,13 +171,15 @@ grpc::Status Stream::GrpcStatus()
 
 void Stream::HalfClose()
 {
+    // 有未完成的写操作时不能WritesDone，由调用方稍后重试
     if (status_ == StreamStatus::WAIT_CONNECT ||
+        status_ == StreamStatus::WAIT_WRITE_DONE ||
         status_ == StreamStatus::FINISHED ||
         status_ == StreamStatus::HALF_CLOSE) {
         return;
     }
 
-    rw_->WritesDone(reinterpret_cast<void*>(ClientEvent::HALF_CLOSE));
+    rw_->WritesDone(tag(ClientEvent::HALF_CLOSE));
     status_ = StreamStatus::HALF_CLOSE;
     log_t("HALF_CLOSE");
     return;
@@ -171,7 +192,7 @@ void Stream::Finish()
         return;
     }
 
-    rw_->Finish(&grpc_status_, reinterpret_cast<void*>(ClientEvent::FINISHED));
+    rw_->Finish(&grpc_status_, tag(ClientEvent::FINISHED));
     status_ = StreamStatus::FINISHED;
     log_t("FINISHED");
 }
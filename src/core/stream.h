@@ -8,10 +8,11 @@
 namespace edu {
 
 class Client;
+struct ClientSession;
 
 class Stream {
   public:
-    Stream(std::shared_ptr<Client> client);
+    Stream(std::shared_ptr<Client> client, ClientSession* session);
     virtual ~Stream();
 
   public:
@@ -25,9 +26,16 @@ class Stream {
     virtual bool IsReadyToSend();
     virtual grpc::Status GrpcStatus();
     virtual void         HalfClose();
+    // 取消stream，可在任意线程调用
+    virtual void Cancel();
+
+  private:
+    void* tag(ClientEvent event);
+    void  write(std::shared_ptr<PushRegReq> req);
 
   private:
     std::shared_ptr<Client>                 client_;
+    ClientSession*                          session_;
     std::shared_ptr<grpc::ClientContext>    ctx_;
     std::unique_ptr<PushData>               push_data_;
     std::unique_ptr<RW>                     rw_;
@@ -15,6 +15,8 @@ using JoinGroupResponse  = grpc::push::gateway::JoinGroupResponse;
 using LeaveGroupRequest  = grpc::push::gateway::LeaveGroupRequest;
 using LeaveGroupResponse = grpc::push::gateway::LeaveGroupResponse;
 using UserGroup          = grpc::push::gateway::UserGroup;
+using PingRequest        = grpc::push::gateway::PingRequest;
+using PongResponse       = grpc::push::gateway::PongResponse;
 using PushData           = grpc::push::gateway::PushData;
 using StreamURI          = grpc::push::gateway::StreamURI;
 using UserTerminalType   = grpc::push::gateway::UserTerminalType;
@@ -29,9 +31,37 @@ enum class ClientEvent {
     READ_DONE  = 2,
     WRITE_DONE = 3,
     HALF_CLOSE = 4,
-    FINISHED   = 5
+    FINISHED   = 5,
+    // 当前通道连接状态变化(NotifyOnStateChange)，tag高位为监听序号
+    CHANNEL_STATE_CHANGED = 6,
+    // 连接竞速中候选通道状态变化，实际事件为 CONNECT_RACE + 候选序号，
+    // tag高位为竞速序号
+    CONNECT_RACE = 100
 };
 
+// 事件只占tag低8位，连接竞速最多使用的地址数，超出的地址不参与竞速
+#define CONNECT_RACE_MAX_CANDIDATES 150
+static_assert(static_cast<int>(ClientEvent::CONNECT_RACE) +
+                      CONNECT_RACE_MAX_CANDIDATES <=
+                  0xff,
+              "connect race index overflows the tag event bits");
+
+// CQ tag 低8位为事件，高位为会话序号，连接自身的事件会话序号为0，
+// 通道状态监听的高位为监听或竞速序号，用于丢弃已替换通道上返回的监听
+#define CLIENT_TAG_SEQ_MASK 0xffffff
+inline void* make_client_tag(uint32_t slot, ClientEvent event)
+{
+    return reinterpret_cast<void*>((static_cast<uintptr_t>(slot) << 8) |
+                                   static_cast<uintptr_t>(event));
+}
+
+inline void parse_client_tag(void* tag, uint32_t& slot, ClientEvent& event)
+{
+    uintptr_t value = reinterpret_cast<uintptr_t>(tag);
+    slot            = static_cast<uint32_t>(value >> 8);
+    event           = static_cast<ClientEvent>(value & 0xff);
+}
+
 enum class StreamStatus {
     WAIT_CONNECT    = 100,
     CONNECTED       = 101,
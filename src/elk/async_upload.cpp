@@ -2,13 +2,38 @@
 #include <common/log.h>
 #include <elk/async_upload.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace edu {
 
 ELKAsyncUploader::ELKAsyncUploader()
 {
-    http_client_ = nullptr;
+    sink_        = nullptr;
+    spool_       = nullptr;
     thread_      = nullptr;
     run_         = false;
+    queue_bytes_ = 0;
+
+    flush_seq_      = 0;
+    flushed_seq_    = 0;
+    flush_deadline_ = 0;
+
+    pushed_       = 0;
+    retry_policy_ = nullptr;
+    next_post_ts_ = 0;
+    post_cost_ms_ = 0;
+    dropped_      = 0;
+    merged_       = 0;
+    sampled_out_  = 0;
+    truncated_    = 0;
+    for (size_t i = 0; i < ELK_THREAD_BUFFER_SLOTS; i++) {
+        buffers_[i].store(nullptr, std::memory_order_relaxed);
+    }
+    shared_buffer_ = std::make_shared<ELKThreadBuffer>();
+
+    std::random_device rd;
+    rng_.seed(rd() ^ static_cast<uint32_t>(Utils::GetSteadyNanoSeconds()));
 }
 
 ELKAsyncUploader::~ELKAsyncUploader()
@@ -22,57 +47,463 @@ ELKAsyncUploader::~ELKAsyncUploader()
         thread_->join();
         thread_ = nullptr;
 
-        http_client_->Close();
-        http_client_ = nullptr;
+        sink_->Close();
+        sink_ = nullptr;
+
+        spool_->Close();
+        spool_ = nullptr;
     }
 }
 
-void ELKAsyncUploader::Initialize()
+void ELKAsyncUploader::Initialize(const std::string& log_dir)
 {
     if (run_) {
         return;
     }
 
     run_ = true;
+    // 上传线程在PushSDKDestroy之后仍然运行，其读取的非热更新配置项一直不可修改
+    Config::Instance()->SetELKRunning(true);
+
+    // 初始化失败时仍保留，发送失败的日志按重试和暂存处理
+    sink_ = ELKSink::Create(Config::Instance()->elk_sink, log_dir);
+    sink_->Initialize();
+
+    spool_ = std::unique_ptr<ELKSpool>(new ELKSpool());
+    if (Config::Instance()->elk_spool_max_bytes > 0 && !log_dir.empty()) {
+        spool_->Open(log_dir + "/" + ELK_SPOOL_FILE_NAME,
+                     Config::Instance()->elk_spool_max_bytes);
+    }
 
-    http_client_ = std::unique_ptr<HttpClient>(new HttpClient());
-    http_client_->Initialize();
+    retry_policy_ = std::unique_ptr<RetryPolicy>(
+        new RetryPolicy(Config::Instance()->elk_upload_retry_base_ms,
+                        Config::Instance()->elk_upload_retry_cap_ms, 2.0));
+    next_post_ts_ = 0;
 
     thread_ = std::unique_ptr<std::thread>(new std::thread([this]() {
-        ELKUploadRequest req;
-        while (run_) {
+        // 输出缓冲在每批之间复用
+        JsonWriter writer;
+        int64_t    last_batch_ts = Utils::GetSteadyMilliSeconds();
+        bool       running       = true;
+        while (running) {
+            ELKUploadBatch batch;
+            bool           flushing       = false;
+            uint64_t       flush_seq      = 0;
+            int64_t        flush_deadline = 0;
             {
                 std::unique_lock<std::mutex> lock(mux_);
-                if (!queue_.empty()) {
-                    std::swap(
-                        const_cast<std::deque<std::shared_ptr<ELKUploadItem>>&>(
-                            req.contents),
-                        queue_);
+                int64_t now      = Utils::GetSteadyMilliSeconds();
+                int64_t interval = Config::Instance()->elk_upload_interval_ms;
+                int64_t wait     = last_batch_ts + interval - now;
+                if (!pending_.empty() || !spool_->Empty()) {
+                    wait = std::min(wait, next_post_ts_ - now);
                 }
-                else if (run_) {
-                    cond_.wait_for(
-                        lock, std::chrono::milliseconds(
-                                  Config::Instance()->elk_upload_interval_ms));
+                // Push不加锁，唤醒可能丢失，最多等到超时
+                if (run_ && flush_seq_ == flushed_seq_ && !batch_ready() &&
+                    pushed_ <= static_cast<uint64_t>(
+                                   Config::Instance()->elk_upload_min_size) &&
+                    wait > 0) {
+                    cond_.wait_for(lock, std::chrono::milliseconds(wait));
+                }
+
+                running        = run_;
+                flushing       = flush_seq_ != flushed_seq_;
+                flush_seq      = flush_seq_;
+                flush_deadline = flush_deadline_;
+            }
+
+            // 收取各线程缓冲中的日志
+            harvest();
+
+            // 数量、字节数或时间任一条件满足时组成一批，退出和Flush时不等待
+            int64_t now     = Utils::GetSteadyMilliSeconds();
+            bool    timeout = now - last_batch_ts >=
+                           Config::Instance()->elk_upload_interval_ms;
+            if (!queue_.empty() &&
+                (!running || flushing || timeout || batch_ready())) {
+                std::swap(batch.req.contents, queue_);
+                queue_bytes_ = 0;
+                // 已经组成批次的日志不能再修改
+                merging_.clear();
+                timeout = true;
+            }
+            if (timeout) {
+                last_batch_ts = now;
+            }
+
+            if (!batch.req.contents.empty()) {
+                pending_.push_back(std::move(batch));
+                // 长时间无法上传时放弃最早的批次
+                int max_pending =
+                    Config::Instance()->elk_upload_max_pending_batches;
+                while (pending_.size() > static_cast<size_t>(
+                                             std::max(1, max_pending))) {
+                    give_up(writer, pending_.front());
+                    pending_.pop_front();
                 }
             }
 
-            if (!req.contents.empty()) {
-                std::string data = req;
-                bool        ok   = false;
-                do {
-                    if ((ok = http_client_->Post(
-                             Config::Instance()->elk_upload_host, 80,
-                             Config::Instance()->elk_upload_path,
-                             Config::Instance()->elk_upload_headers, data)) !=
-                        true) {
-                        //不丢弃数据,尝试重试
-                        usleep(500 * 1000);
-                    }
-                } while (!ok && run_);
-                req.contents.clear();
+            if (!running) {
+                break;
+            }
+
+            if (flushing) {
+                upload(writer, flush_deadline);
+                std::unique_lock<std::mutex> lock(mux_);
+                flushed_seq_ = flush_seq;
+                flush_cond_.notify_all();
+            }
+            else {
+                upload(writer, 0);
             }
         }
+
+        // 退出前在限定时间内上传剩余日志，之后仍未成功的写入暂存文件
+        upload(writer, Utils::GetSteadyMilliSeconds() +
+                           Config::Instance()->elk_upload_flush_timeout_ms);
+        for (ELKUploadBatch& batch : pending_) {
+            give_up(writer, batch);
+        }
+        pending_.clear();
     }));
 }
 
+// 拷贝字符串到定长数组，超长时截断并返回true
+template <size_t N> static inline bool copy_text(char (&dst)[N], ELKText src)
+{
+    size_t len = src.size < N - 1 ? src.size : N - 1;
+    memcpy(dst, src.data, len);
+    dst[len] = '\0';
+    return len < src.size;
+}
+
+void ELKAsyncUploader::Push(ELKText  system_time,
+                            uint64_t appid,
+                            uint32_t uid,
+                            uint64_t suid,
+                            ELKText  group_info,
+                            ELKText  action,
+                            int      code,
+                            ELKText  msg)
+{
+    if (!run_) {
+        return;
+    }
+
+    auto fill = [&](ELKRecord& r) {
+        bool truncated = copy_text(r.system_time, system_time);
+        truncated |= copy_text(r.action, action);
+        truncated |= copy_text(r.group_info, group_info);
+        truncated |= copy_text(r.msg, msg);
+        r.appid     = appid;
+        r.suid      = suid;
+        r.uid       = uid;
+        r.code      = code;
+        r.truncated = truncated;
+    };
+
+    ELKThreadBuffer* buffer = thread_buffer();
+    bool             ok     = false;
+    if (buffer) {
+        ok = buffer->ring.Push(fill);
+    }
+    else {
+        buffer = shared_buffer_.get();
+        std::unique_lock<std::mutex> lock(shared_mux_);
+        ok = buffer->ring.Push(fill);
+    }
+    if (!ok) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // 只在越过批次大小时唤醒一次上传线程
+    if (pushed_.fetch_add(1, std::memory_order_relaxed) ==
+        static_cast<uint64_t>(Config::Instance()->elk_upload_min_size)) {
+        cond_.notify_one();
+    }
+}
+
+ELKThreadBuffer* ELKAsyncUploader::thread_buffer()
+{
+    std::thread::id id    = std::this_thread::get_id();
+    size_t          start = std::hash<std::thread::id>()(id);
+
+    // 已登记的线程不加锁，遇到空槽位说明还没有登记
+    for (size_t i = 0; i < ELK_THREAD_BUFFER_SLOTS; i++) {
+        ELKThreadBuffer* buffer =
+            buffers_[(start + i) % ELK_THREAD_BUFFER_SLOTS].load(
+                std::memory_order_acquire);
+        if (!buffer) {
+            break;
+        }
+        if (buffer->owner == id) {
+            return buffer;
+        }
+    }
+
+    // 第一次Push，加锁后在第一个空槽位登记
+    std::unique_lock<std::mutex> lock(buffers_mux_);
+    for (size_t i = 0; i < ELK_THREAD_BUFFER_SLOTS; i++) {
+        std::atomic<ELKThreadBuffer*>& slot =
+            buffers_[(start + i) % ELK_THREAD_BUFFER_SLOTS];
+        ELKThreadBuffer* buffer = slot.load(std::memory_order_acquire);
+        if (!buffer) {
+            owned_.push_back(std::make_shared<ELKThreadBuffer>());
+            buffer        = owned_.back().get();
+            buffer->owner = id;
+            slot.store(buffer, std::memory_order_release);
+            return buffer;
+        }
+        if (buffer->owner == id) {
+            return buffer;
+        }
+    }
+    return nullptr;
+}
+
+void ELKAsyncUploader::harvest()
+{
+    pushed_.store(0, std::memory_order_relaxed);
+
+    // 上传线程是所有缓冲唯一的消费者，收取时不需要加锁
+    uint64_t dropped = 0;
+    auto     consume = [this, &dropped](ELKThreadBuffer* buffer) {
+        buffer->ring.Consume([this](const ELKRecord& r) { add(r); });
+        dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+    };
+    for (size_t i = 0; i < ELK_THREAD_BUFFER_SLOTS; i++) {
+        ELKThreadBuffer* buffer = buffers_[i].load(std::memory_order_acquire);
+        if (buffer) {
+            consume(buffer);
+        }
+    }
+    consume(shared_buffer_.get());
+
+    if (dropped > 0) {
+        dropped_ += dropped;
+        log_w("drop {} elk logs. thread buffer full", dropped);
+    }
+}
+
+void ELKAsyncUploader::add(const ELKRecord& record)
+{
+    if (record.truncated) {
+        truncated_++;
+    }
+
+    // 失败的日志不采样
+    if (record.code == 0 && !sampled(record.action)) {
+        sampled_out_++;
+        return;
+    }
+
+    std::shared_ptr<ELKUploadItem> item =
+        std::make_shared<ELKUploadItem>(record);
+
+    // 合并窗口从日志被收取时开始计算，收取间隔远小于窗口
+    int64_t window = Config::Instance()->elk_aggregate_window_ms;
+    if (window > 0) {
+        int64_t        now   = Utils::GetSteadyMilliSeconds();
+        ELKMergeEntry& entry = merging_[merge_key(*item)];
+        if (entry.item && now - entry.first_ts < window) {
+            entry.item->Merge(item->system_time);
+            merged_++;
+            return;
+        }
+        entry.item     = item;
+        entry.first_ts = now;
+    }
+
+    queue_.push_back(item);
+    queue_bytes_ += item->Size();
+
+    if (queue_.size() >
+        static_cast<size_t>(Config::Instance()->elk_upload_max_size)) {
+        // 丢弃头部的日志
+        std::shared_ptr<ELKUploadItem> pitem = queue_.front();
+        queue_.pop_front();
+        queue_bytes_ -= pitem->Size();
+        dropped_++;
+
+        auto it = merging_.find(merge_key(*pitem));
+        if (it != merging_.end() && it->second.item == pitem) {
+            merging_.erase(it);
+        }
+        log_w("drop elk log. action={}, code={}", pitem->action, pitem->code);
+    }
+}
+
+void ELKAsyncUploader::Flush(int timeout_ms)
+{
+    if (!run_) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mux_);
+    uint64_t                     seq = ++flush_seq_;
+    flush_deadline_ = Utils::GetSteadyMilliSeconds() + timeout_ms;
+    cond_.notify_one();
+
+    flush_cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                         [this, seq]() { return flushed_seq_ >= seq; });
+}
+
+bool ELKAsyncUploader::batch_ready()
+{
+    return queue_.size() > static_cast<size_t>(
+                               Config::Instance()->elk_upload_min_size) ||
+           queue_bytes_ >= static_cast<size_t>(
+                               Config::Instance()->elk_upload_batch_bytes);
+}
+
+bool ELKAsyncUploader::sampled(const std::string& action)
+{
+    const std::map<std::string, double>& rates =
+        Config::Instance()->elk_sample_rates;
+
+    auto it = rates.find(action);
+    if (it == rates.end() || it->second >= 1.0) {
+        return true;
+    }
+    if (it->second <= 0.0) {
+        return false;
+    }
+
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    return dist(rng_) < it->second;
+}
+
+std::string ELKAsyncUploader::merge_key(const ELKUploadItem& item)
+{
+    std::string key = std::to_string(item.suid);
+    key += '\n';
+    key += item.group_info;
+    key += '\n';
+    key += item.action;
+    key += '\n';
+    key += std::to_string(item.code);
+    key += '\n';
+    key += item.msg;
+    return key;
+}
+
+void ELKAsyncUploader::upload(JsonWriter& writer, int64_t deadline)
+{
+    int max_attempts =
+        std::max(1, Config::Instance()->elk_upload_max_attempts.load());
+
+    while (!pending_.empty()) {
+        // 正常上传时遵守退避时间，Flush时按上次发送耗时估算，
+        // 截止前发不完的批次留到之后处理
+        int64_t now = Utils::GetSteadyMilliSeconds();
+        if (deadline > 0 ? now + post_cost_ms_ >= deadline
+                         : now < next_post_ts_) {
+            return;
+        }
+
+        ELKUploadBatch batch = std::move(pending_.front());
+        pending_.pop_front();
+
+        if (post(batch.req, writer)) {
+            continue;
+        }
+
+        // Flush时发送失败说明网络不可用，不再立即重发，剩余批次写入暂存文件
+        if (deadline > 0) {
+            batch.attempts++;
+            give_up(writer, batch);
+            for (ELKUploadBatch& b : pending_) {
+                give_up(writer, b);
+            }
+            pending_.clear();
+            return;
+        }
+
+        if (++batch.attempts >= max_attempts) {
+            give_up(writer, batch);
+        }
+        else {
+            // 放到队尾，不阻塞之后的批次
+            pending_.push_back(std::move(batch));
+        }
+        return;
+    }
+
+    if (deadline == 0 && Utils::GetSteadyMilliSeconds() >= next_post_ts_) {
+        // 网络正常时上传之前暂存的日志
+        drain_spool(writer);
+    }
+}
+
+void ELKAsyncUploader::give_up(JsonWriter& writer, ELKUploadBatch& batch)
+{
+    size_t count = batch.req.contents.size();
+    if (spool_->IsOpen()) {
+        // 写入暂存文件，网络恢复后再上传
+        for (std::shared_ptr<ELKUploadItem>& item : batch.req.contents) {
+            writer.Clear();
+            item->Write(writer);
+            spool_->Append(writer.Data());
+        }
+        spool_->Flush();
+        log_w("spool {} elk logs. attempts={}", count, batch.attempts);
+    }
+    else {
+        dropped_ += count;
+        log_w("drop {} elk logs. attempts={}", count, batch.attempts);
+    }
+    batch.req.contents.clear();
+}
+
+void ELKAsyncUploader::drain_spool(JsonWriter& writer)
+{
+    // 每次上传一大批，失败时保留在文件中等退避结束后再试
+    ELKUploadRequest req;
+    while (run_ && !spool_->Empty()) {
+        req.raw_contents.clear();
+        uint64_t end = spool_->Read(
+            static_cast<size_t>(Config::Instance()->elk_spool_drain_bytes),
+            req.raw_contents);
+
+        if (!post(req, writer)) {
+            break;
+        }
+        spool_->Commit(end);
+    }
+    spool_->Flush();
+}
+
+bool ELKAsyncUploader::post(const ELKUploadRequest& req, JsonWriter& writer)
+{
+    int64_t start = Utils::GetSteadyMilliSeconds();
+    bool    ok    = sink_->Send(req, writer);
+    post_cost_ms_ = Utils::GetSteadyMilliSeconds() - start;
+
+    if (!ok) {
+        next_post_ts_ =
+            Utils::GetSteadyMilliSeconds() + retry_policy_->NextBackoffMs();
+        return false;
+    }
+
+    retry_policy_->Reset();
+    next_post_ts_ = 0;
+    return true;
+}
+
+void ELKAsyncUploader::GetStats(PushSDKStats& stats)
+{
+    if (!run_) {
+        return;
+    }
+
+    sink_->GetStats(stats);
+    stats.elk_spool_bytes   = spool_->Bytes();
+    stats.elk_spool_dropped = spool_->Dropped();
+    stats.elk_dropped       = dropped_ + sink_->Dropped();
+    stats.elk_merged        = merged_;
+    stats.elk_sampled_out   = sampled_out_;
+    stats.elk_truncated     = truncated_;
+}
+
 }  // namespace edu
\ No newline at end of file
@@ -1,71 +1,161 @@
 #ifndef EDU_PUSH_SDK_ASYNC_UPLOAD_H
 #define EDU_PUSH_SDK_ASYNC_UPLOAD_H
 
-#include <common/http_client.h>
+#include <common/clock.h>
+#include <common/retry_policy.h>
 #include <common/singleton.h>
+#include <common/spsc_ring.h>
 #include <common/utils.h>
+#include <elk/sink.h>
+#include <elk/spool.h>
 #include <elk/upload_request.h>
+#include <push_sdk.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <deque>
+#include <random>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define ELK_SPOOL_FILE_NAME "push_sdk_elk.spool"
+// 每个调用线程缓冲的日志条数
+#define ELK_THREAD_BUFFER_SIZE 128
+// 按线程ID索引的缓冲表大小，表满后新线程共用一个加锁的缓冲
+#define ELK_THREAD_BUFFER_SLOTS 64
 
 namespace edu {
+
+// 一批待上传的日志，上传失败后留在待重试队列中
+struct ELKUploadBatch
+{
+    ELKUploadBatch()
+    {
+        attempts = 0;
+    }
+
+    ELKUploadRequest req;
+    int              attempts;
+};
+
+// 合并窗口内的日志及窗口开始时间
+struct ELKMergeEntry
+{
+    ELKMergeEntry()
+    {
+        first_ts = 0;
+    }
+
+    std::shared_ptr<ELKUploadItem> item;
+    int64_t                        first_ts;
+};
+
+// 每个调用Push的线程一个日志缓冲，不使用thread_local(ios工具链不支持)，
+// 按线程ID登记，线程退出后ID被复用时新线程接着使用同一个缓冲
+struct ELKThreadBuffer
+{
+    ELKThreadBuffer()
+    {
+        dropped = 0;
+    }
+
+    std::thread::id                             owner;
+    SpscRing<ELKRecord, ELK_THREAD_BUFFER_SIZE> ring;
+    // 缓冲满时丢弃的日志数
+    std::atomic<uint64_t> dropped;
+};
+
 class ELKAsyncUploader : public Singleton<ELKAsyncUploader> {
     friend class Singleton<ELKAsyncUploader>;
 
   public:
     ~ELKAsyncUploader();
 
-    void Initialize();
+    // 暂存文件和file方式的日志文件放在log_dir下，log_dir为空时不使用磁盘暂存
+    void Initialize(const std::string& log_dir = "");
+
+    // 立即上传已缓存的日志，最多等待timeout_ms，不影响之后继续上传
+    void Flush(int timeout_ms);
+
+    void GetStats(PushSDKStats& stats);
 
   public:
     ELKAsyncUploader();
 
-    template <typename... Args> void Push(Args... args)
-    {
-        if (!run_) {
-            return;
-        }
-
-        std::shared_ptr<ELKUploadItem> pitem = nullptr;
-
-        std::unique_lock<std::mutex> lock(mux_);
-        queue_.emplace_back(
-            std::make_shared<ELKUploadItem>(std::forward<Args>(args)...));
-
-        if (queue_.size() >
-            static_cast<size_t>(Config::Instance()->elk_upload_max_size)) {
-            // 丢弃头部的日志
-            pitem = queue_.front();
-            queue_.pop_front();
-        }
-
-        if (queue_.size() >
-            static_cast<size_t>(Config::Instance()->elk_upload_min_size)) {
-            cond_.notify_one();
-        }
-
-        lock.unlock();
-
-        if (pitem) {
-            std::string logstr = *pitem;
-            log_w("drop elk log--> {}", logstr);
-        }
-    }
+    // 写入调用线程的缓冲，不加锁、不分配内存，缓冲满时丢弃，线程安全
+    void Push(ELKText  system_time,
+              uint64_t appid,
+              uint32_t uid,
+              uint64_t suid,
+              ELKText  group_info,
+              ELKText  action,
+              int      code,
+              ELKText  msg);
+
+  private:
+    // 查找调用线程的缓冲，不加锁，线程第一次Push时加锁登记，
+    // 缓冲表已满时返回nullptr，调用方改用shared_buffer_
+    ELKThreadBuffer* thread_buffer();
+
+    // 以下函数只在上传线程中调用
+    void        harvest();
+    void        add(const ELKRecord& record);
+    bool        batch_ready();
+    bool        sampled(const std::string& action);
+    std::string merge_key(const ELKUploadItem& item);
+    void        upload(JsonWriter& writer, int64_t deadline);
+    void        give_up(JsonWriter& writer, ELKUploadBatch& batch);
+    void        drain_spool(JsonWriter& writer);
+    bool        post(const ELKUploadRequest& req, JsonWriter& writer);
 
   private:
-    std::unique_ptr<HttpClient>                http_client_;
-    std::unique_ptr<std::thread>               thread_;
-    bool                                       run_;
-    std::mutex                                 mux_;
+    std::unique_ptr<ELKSink>     sink_;
+    std::unique_ptr<ELKSpool>    spool_;
+    std::unique_ptr<std::thread> thread_;
+    bool                         run_;
+    std::mutex                   mux_;
+    std::condition_variable      cond_;
+
+    // 各线程的日志缓冲，按线程ID哈希后线性探测，槽位只增不减，
+    // 登记新缓冲时由buffers_mux_保护，owned_持有所有缓冲
+    std::atomic<ELKThreadBuffer*> buffers_[ELK_THREAD_BUFFER_SLOTS];
+    std::vector<std::shared_ptr<ELKThreadBuffer>> owned_;
+    std::mutex                                    buffers_mux_;
+    // 缓冲表满时所有新线程共用，shared_mux_保证同一时刻只有一个生产者
+    std::shared_ptr<ELKThreadBuffer> shared_buffer_;
+    std::mutex                       shared_mux_;
+    // 上次收取之后写入缓冲的日志数，超过批次大小时唤醒上传线程
+    std::atomic<uint64_t> pushed_;
+
+    // Flush请求序号和上传线程已完成的序号，由mux_保护
+    uint64_t                flush_seq_;
+    uint64_t                flushed_seq_;
+    int64_t                 flush_deadline_;
+    std::condition_variable flush_cond_;
+
+    // 以下成员只在上传线程中访问
     std::deque<std::shared_ptr<ELKUploadItem>> queue_;
-    std::condition_variable                    cond_;
+    size_t                                     queue_bytes_;
+    // 还在queue_中的可合并日志，组成一批后清空
+    std::unordered_map<std::string, ELKMergeEntry> merging_;
+    std::minstd_rand                               rng_;
+    // 待重试的批次和退避状态
+    std::deque<ELKUploadBatch>   pending_;
+    std::unique_ptr<RetryPolicy> retry_policy_;
+    int64_t                      next_post_ts_;
+    // 最近一次发送的耗时(ms)，限时上传时据此判断能否在截止时间前完成
+    int64_t post_cost_ms_;
+
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> merged_;
+    std::atomic<uint64_t> sampled_out_;
+    std::atomic<uint64_t> truncated_;
 };
 }  // namespace edu
 
 #define ELK_UPLOAD(...)                                                        \
     ELKAsyncUploader::Instance()->Push(                                        \
-        Utils::GetSystemTime("%Y-%m-%d %H:%M:%S"), __VA_ARGS__)
+        CachedClock::Instance()->Now().str, __VA_ARGS__)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include <elk/json_writer.h>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define PS_JSON_USE_SSE2
+#endif
+
+namespace edu {
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+static const char kDigitPairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static inline bool need_escape(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// 返回从p开始第一个需要转义的字符的偏移，没有时返回len。
+// 日志内容绝大多数不需要转义，按块扫描后整段拷贝
+static size_t find_escape(const char* p, size_t len)
+{
+    size_t i = 0;
+#ifdef PS_JSON_USE_SSE2
+    const __m128i quote     = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    // 有符号比较，0x20以下为控制字符
+    const __m128i space = _mm_set1_epi8(0x20);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i ctrl = _mm_andnot_si128(
+            _mm_cmplt_epi8(chunk, _mm_setzero_si128()),
+            _mm_cmplt_epi8(chunk, space));
+        __m128i hit = _mm_or_si128(
+            ctrl, _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                               _mm_cmpeq_epi8(chunk, backslash)));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            for (int bit = 0; bit < 16; bit++) {
+                if (mask & (1 << bit)) {
+                    return i + bit;
+                }
+            }
+        }
+    }
+#else
+    // 没有SSE2时每次检查8个字节
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        uint64_t lt_space  = (w - ones * 0x20) & ~w;
+        uint64_t quote     = w ^ (ones * '"');
+        uint64_t backslash = w ^ (ones * '\\');
+        uint64_t hit       = lt_space | ((quote - ones) & ~quote) |
+                       ((backslash - ones) & ~backslash);
+        if (hit & high) {
+            break;
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (need_escape(static_cast<unsigned char>(p[i]))) {
+            return i;
+        }
+    }
+    return len;
+}
+
+JsonWriter::JsonWriter()
+{
+    has_value_ = false;
+}
+
+void JsonWriter::Clear()
+{
+    buf_.clear();
+    has_value_ = false;
+}
+
+void JsonWriter::BeginObject()
+{
+    separate();
+    buf_ += '{';
+    has_value_ = false;
+}
+
+void JsonWriter::EndObject()
+{
+    buf_ += '}';
+    has_value_ = true;
+}
+
+void JsonWriter::BeginArray()
+{
+    separate();
+    buf_ += '[';
+    has_value_ = false;
+}
+
+void JsonWriter::EndArray()
+{
+    buf_ += ']';
+    has_value_ = true;
+}
+
+void JsonWriter::Key(const char* key)
+{
+    separate();
+    buf_ += '"';
+    buf_ += key;
+    buf_ += "\":";
+    // 紧跟的值前面不需要逗号
+    has_value_ = false;
+}
+
+void JsonWriter::String(const char* str, size_t len)
+{
+    separate();
+    buf_ += '"';
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n = find_escape(str + pos, len - pos);
+        buf_.append(str + pos, n);
+        pos += n;
+        if (pos >= len) {
+            break;
+        }
+
+        unsigned char c = static_cast<unsigned char>(str[pos++]);
+        switch (c) {
+            case '"': buf_ += "\\\""; break;
+            case '\\': buf_ += "\\\\"; break;
+            case '\b': buf_ += "\\b"; break;
+            case '\f': buf_ += "\\f"; break;
+            case '\n': buf_ += "\\n"; break;
+            case '\r': buf_ += "\\r"; break;
+            case '\t': buf_ += "\\t"; break;
+            default: {
+                char esc[] = {'\\', 'u', '0', '0', kHexDigits[c >> 4],
+                              kHexDigits[c & 0xf]};
+                buf_.append(esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+
+    buf_ += '"';
+    has_value_ = true;
+}
+
+void JsonWriter::String(const std::string& str)
+{
+    String(str.data(), str.size());
+}
+
+void JsonWriter::Int(int64_t v)
+{
+    if (v < 0) {
+        separate();
+        buf_ += '-';
+        // 先转成无符号再取反，INT64_MIN也不会溢出
+        has_value_ = false;
+        Uint(0 - static_cast<uint64_t>(v));
+        return;
+    }
+    Uint(static_cast<uint64_t>(v));
+}
+
+void JsonWriter::Uint(uint64_t v)
+{
+    separate();
+
+    // 从低位开始每次写两位数字
+    char  tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        unsigned idx = static_cast<unsigned>(v % 100) * 2;
+        v /= 100;
+        *--p = kDigitPairs[idx + 1];
+        *--p = kDigitPairs[idx];
+    }
+    if (v >= 10) {
+        unsigned idx = static_cast<unsigned>(v) * 2;
+        *--p         = kDigitPairs[idx + 1];
+        *--p         = kDigitPairs[idx];
+    }
+    else {
+        *--p = static_cast<char>('0' + v);
+    }
+
+    buf_.append(p, tmp + sizeof(tmp) - p);
+    has_value_ = true;
+}
+
+void JsonWriter::Bool(bool v)
+{
+    separate();
+    buf_ += v ? "true" : "false";
+    has_value_ = true;
+}
+
+void JsonWriter::Raw(const std::string& json)
+{
+    separate();
+    buf_ += json;
+    has_value_ = true;
+}
+
+const std::string& JsonWriter::Data() const
+{
+    return buf_;
+}
+
+void JsonWriter::separate()
+{
+    if (has_value_) {
+        buf_ += ',';
+    }
+}
+
+}  // namespace edu
\ No newline at end of file
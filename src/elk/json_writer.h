@@ -0,0 +1,47 @@
+#ifndef EDU_PUSH_SDK_JSON_WRITER_H
+#define EDU_PUSH_SDK_JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace edu {
+
+// 直接向输出缓冲追加JSON文本的流式writer，缓冲在多次序列化之间复用。
+// 不检查结构是否合法，由调用方保证Begin/End及Key/Value成对出现，非线程安全
+class JsonWriter {
+  public:
+    JsonWriter();
+
+  public:
+    void Clear();
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    // key只能是不需要转义的字面量
+    void Key(const char* key);
+    void String(const char* str, size_t len);
+    void String(const std::string& str);
+    void Int(int64_t v);
+    void Uint(uint64_t v);
+    void Bool(bool v);
+    // 直接追加已经是合法JSON的片段，如预先渲染好的字段
+    void Raw(const std::string& json);
+
+    const std::string& Data() const;
+
+  private:
+    void separate();
+
+  private:
+    std::string buf_;
+    // 当前层级是否已有元素，决定是否需要先写逗号
+    bool has_value_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
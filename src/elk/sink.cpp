@@ -0,0 +1,411 @@
+#include <common/config.h>
+#include <common/log.h>
+#include <elk/sink.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#    include <netdb.h>
+#    include <sys/socket.h>
+#    include <sys/time.h>
+#    include <sys/types.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#else
+#    include <io.h>
+#endif
+
+#define ELK_SINK_FILE_NAME "push_sdk_elk.ndjson"
+// 超过该大小的日志无法放进一个UDP报文
+#define ELK_SINK_UDP_MAX_BYTES 65000
+// 写Unix域套接字的超时时间，与HTTP连接超时一致
+#define ELK_SINK_SEND_TIMEOUT_SEC 1
+
+namespace edu {
+
+ELKSink::ELKSink()
+{
+    requests_   = 0;
+    failures_   = 0;
+    sent_bytes_ = 0;
+    dropped_    = 0;
+}
+
+std::unique_ptr<ELKSink> ELKSink::Create(const std::string& type,
+                                         const std::string& log_dir)
+{
+    const std::string& address = Config::Instance()->elk_sink_address;
+
+    if (type == "file") {
+        std::string path = address;
+        if (path.empty()) {
+            path = log_dir + "/" + ELK_SINK_FILE_NAME;
+        }
+        return std::unique_ptr<ELKSink>(new ELKFileSink(path));
+    }
+#ifndef _WIN32
+    if (type == "udp") {
+        return std::unique_ptr<ELKSink>(new ELKUdpSink(address));
+    }
+    if (type == "unix") {
+        return std::unique_ptr<ELKSink>(new ELKUnixSink(address));
+    }
+#endif
+    if (type != "http") {
+        log_w("elk sink {} not supported, use http", type);
+    }
+    return std::unique_ptr<ELKSink>(new ELKHttpSink());
+}
+
+void ELKSink::GetStats(PushSDKStats& stats)
+{
+    stats.elk_requests   = requests_;
+    stats.elk_failures   = failures_;
+    stats.elk_raw_bytes  = sent_bytes_;
+    stats.elk_sent_bytes = sent_bytes_;
+}
+
+uint64_t ELKSink::Dropped()
+{
+    return dropped_;
+}
+
+void ELKSink::write_lines(const ELKUploadRequest& req,
+                          JsonWriter&             writer,
+                          std::string&            out)
+{
+    out.clear();
+    for (const std::shared_ptr<ELKUploadItem>& item : req.contents) {
+        writer.Clear();
+        item->Write(writer);
+        out += writer.Data();
+        out += '\n';
+    }
+    for (const std::string& item : req.raw_contents) {
+        out += item;
+        out += '\n';
+    }
+}
+
+bool ELKHttpSink::Initialize()
+{
+    http_client_ = std::unique_ptr<HttpClient>(new HttpClient());
+    http_client_->Initialize();
+    return true;
+}
+
+void ELKHttpSink::Close()
+{
+    if (http_client_) {
+        http_client_->Close();
+        http_client_ = nullptr;
+    }
+}
+
+bool ELKHttpSink::Send(const ELKUploadRequest& req, JsonWriter& writer)
+{
+    writer.Clear();
+    req.Write(writer);
+    return http_client_->Post(Config::Instance()->elk_upload_host, 80,
+                              Config::Instance()->elk_upload_path,
+                              Config::Instance()->elk_upload_headers,
+                              writer.Data());
+}
+
+void ELKHttpSink::GetStats(PushSDKStats& stats)
+{
+    http_client_->GetStats(stats.elk_requests, stats.elk_failures,
+                           stats.elk_raw_bytes, stats.elk_sent_bytes);
+}
+
+ELKFileSink::ELKFileSink(const std::string& path)
+{
+    path_ = path;
+    file_ = nullptr;
+}
+
+bool ELKFileSink::Initialize()
+{
+    file_ = fopen(path_.c_str(), "ab");
+    if (!file_) {
+        log_e("open elk sink file {} failed. errno={}", path_, errno);
+        return false;
+    }
+    return true;
+}
+
+void ELKFileSink::Close()
+{
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool ELKFileSink::Send(const ELKUploadRequest& req, JsonWriter& writer)
+{
+    requests_++;
+    if (!file_ && !Initialize()) {
+        failures_++;
+        return false;
+    }
+
+    // 整批一次写入，失败时截断到写入前的长度，文件中不留下半条日志
+    fseek(file_, 0, SEEK_END);
+    long start = ftell(file_);
+
+    write_lines(req, writer, buf_);
+    if (fwrite(buf_.data(), 1, buf_.size(), file_) != buf_.size() ||
+        fflush(file_) != 0) {
+        log_e("write elk sink file {} failed. errno={}", path_, errno);
+        failures_++;
+        Close();
+        truncate_to(start);
+        return false;
+    }
+
+    sent_bytes_ += buf_.size();
+    return true;
+}
+
+void ELKFileSink::truncate_to(long size)
+{
+    if (size < 0) {
+        return;
+    }
+
+    // 关闭时缓冲区中剩余的内容可能已写入，重新打开后再截断
+    FILE* file = fopen(path_.c_str(), "r+b");
+    if (!file) {
+        log_e("open elk sink file {} failed. errno={}", path_, errno);
+        return;
+    }
+#ifdef _WIN32
+    int ret = _chsize_s(_fileno(file), size);
+#else
+    int ret = ftruncate(fileno(file), size);
+#endif
+    if (ret != 0) {
+        log_e("truncate elk sink file {} failed. errno={}", path_, errno);
+    }
+    fclose(file);
+}
+
+#ifndef _WIN32
+ELKUdpSink::ELKUdpSink(const std::string& address)
+{
+    address_ = address;
+    fd_      = -1;
+}
+
+bool ELKUdpSink::Initialize()
+{
+    return connect_socket();
+}
+
+void ELKUdpSink::Close()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool ELKUdpSink::Send(const ELKUploadRequest& req, JsonWriter& writer)
+{
+    requests_++;
+    if (fd_ < 0 && !connect_socket()) {
+        failures_++;
+        return false;
+    }
+
+    auto send_line = [this](const std::string& line) {
+        // 一个报文放不下的日志无法发送，计入丢弃数，不影响同批的其他日志
+        if (line.size() > ELK_SINK_UDP_MAX_BYTES) {
+            dropped_++;
+            log_w("drop elk log too large for udp. size={}", line.size());
+            return true;
+        }
+        if (send(fd_, line.data(), line.size(), 0) < 0) {
+            log_e("send elk log to {} failed. errno={}", address_, errno);
+            return false;
+        }
+        sent_bytes_ += line.size();
+        return true;
+    };
+
+    for (const std::shared_ptr<ELKUploadItem>& item : req.contents) {
+        writer.Clear();
+        item->Write(writer);
+        buf_ = writer.Data();
+        buf_ += '\n';
+        if (!send_line(buf_)) {
+            failures_++;
+            return false;
+        }
+    }
+    for (const std::string& item : req.raw_contents) {
+        buf_ = item;
+        buf_ += '\n';
+        if (!send_line(buf_)) {
+            failures_++;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ELKUdpSink::connect_socket()
+{
+    // 地址格式为host:port，IPv6地址带[]
+    size_t pos = address_.rfind(':');
+    if (pos == std::string::npos || pos == 0) {
+        log_e("invalid elk udp sink address {}", address_);
+        return false;
+    }
+
+    std::string host = address_.substr(0, pos);
+    std::string port = address_.substr(pos + 1);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo* res = nullptr;
+    int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (ret != 0) {
+        log_e("resolve elk udp sink {} failed. err={}", address_,
+              gai_strerror(ret));
+        return false;
+    }
+
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd_ < 0) {
+            continue;
+        }
+        // UDP的connect只记录目标地址，之后直接send
+        if (connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd_);
+        fd_ = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd_ < 0) {
+        log_e("connect elk udp sink {} failed. errno={}", address_, errno);
+        return false;
+    }
+    return true;
+}
+
+ELKUnixSink::ELKUnixSink(const std::string& path)
+{
+    path_         = path;
+    fd_           = -1;
+    partial_line_ = false;
+}
+
+bool ELKUnixSink::Initialize()
+{
+    // 采集程序可能还没启动，发送时再重连
+    connect_socket();
+    return true;
+}
+
+void ELKUnixSink::Close()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    // 新连接从行首开始
+    partial_line_ = false;
+}
+
+bool ELKUnixSink::Send(const ELKUploadRequest& req, JsonWriter& writer)
+{
+    requests_++;
+    if (fd_ < 0 && !connect_socket()) {
+        failures_++;
+        return false;
+    }
+
+    // 先结束上次写了一半的行，半行单独成为一条无效日志，不会与后面的日志拼接
+    write_lines(req, writer, buf_);
+    if (partial_line_) {
+        buf_.insert(0, 1, '\n');
+    }
+
+    int flags = 0;
+#    ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL;
+#    endif
+    size_t off = 0;
+    while (off < buf_.size()) {
+        ssize_t n = send(fd_, buf_.data() + off, buf_.size() - off, flags);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            log_e("write elk unix sink {} failed. errno={}", path_, errno);
+            failures_++;
+            // 发送超时时连接仍可用，partial_line_记录是否留下半行，
+            // 下次发送时补换行，其他错误关闭连接后重连
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                Close();
+            }
+            return false;
+        }
+        off += static_cast<size_t>(n);
+        partial_line_ = buf_[off - 1] != '\n';
+    }
+
+    sent_bytes_ += buf_.size();
+    return true;
+}
+
+bool ELKUnixSink::connect_socket()
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path_.empty() || path_.size() >= sizeof(addr.sun_path)) {
+        log_e("invalid elk unix sink path {}", path_);
+        return false;
+    }
+    memcpy(addr.sun_path, path_.data(), path_.size());
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+        log_e("create unix socket failed. errno={}", errno);
+        return false;
+    }
+
+#    ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#    endif
+    struct timeval tv;
+    tv.tv_sec  = ELK_SINK_SEND_TIMEOUT_SEC;
+    tv.tv_usec = 0;
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (connect(fd_, reinterpret_cast<struct sockaddr*>(&addr),
+                sizeof(addr)) != 0) {
+        log_w("connect elk unix sink {} failed. errno={}", path_, errno);
+        Close();
+        return false;
+    }
+    return true;
+}
+#endif
+
+}  // namespace edu
\ No newline at end of file
@@ -0,0 +1,125 @@
+#ifndef EDU_PUSH_SDK_SINK_H
+#define EDU_PUSH_SDK_SINK_H
+
+#include <common/http_client.h>
+#include <elk/json_writer.h>
+#include <elk/upload_request.h>
+#include <push_sdk.h>
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <string>
+
+namespace edu {
+
+// ELK日志的发送目标，由elk_sink配置选择，只在ELK上传线程中使用
+class ELKSink {
+  public:
+    ELKSink();
+    virtual ~ELKSink() {}
+
+  public:
+    // type为"http"、"file"、"udp"、"unix"，未知类型或当前平台不支持时使用http
+    static std::unique_ptr<ELKSink> Create(const std::string& type,
+                                           const std::string& log_dir);
+
+    virtual bool Initialize() = 0;
+    virtual void Close()      = 0;
+    // 发送一批日志，失败时整批重试，可能重复发送其中已成功的日志
+    virtual bool Send(const ELKUploadRequest& req, JsonWriter& writer) = 0;
+
+    virtual void GetStats(PushSDKStats& stats);
+    // 发送时丢弃的日志数，如超过UDP报文大小的日志
+    virtual uint64_t Dropped();
+
+  protected:
+    // 每条日志一行的NDJSON格式
+    static void write_lines(const ELKUploadRequest& req,
+                            JsonWriter&             writer,
+                            std::string&            out);
+
+  protected:
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> failures_;
+    std::atomic<uint64_t> sent_bytes_;
+    std::atomic<uint64_t> dropped_;
+};
+
+// POST到elk_upload_host
+class ELKHttpSink : public ELKSink {
+  public:
+    virtual bool Initialize() override;
+    virtual void Close() override;
+    virtual bool Send(const ELKUploadRequest& req, JsonWriter& writer) override;
+    virtual void GetStats(PushSDKStats& stats) override;
+
+  private:
+    std::unique_ptr<HttpClient> http_client_;
+};
+
+// 追加写入本地NDJSON文件，由本机的日志采集程序上报
+class ELKFileSink : public ELKSink {
+  public:
+    explicit ELKFileSink(const std::string& path);
+
+  public:
+    virtual bool Initialize() override;
+    virtual void Close() override;
+    virtual bool Send(const ELKUploadRequest& req, JsonWriter& writer) override;
+
+  private:
+    // 写入失败时把文件截断到写入前的长度，去掉写了一半的日志
+    void truncate_to(long size);
+
+  private:
+    std::string path_;
+    FILE*       file_;
+    std::string buf_;
+};
+
+#ifndef _WIN32
+// 每条日志一个UDP报文，发送到elk_sink_address("host:port")
+class ELKUdpSink : public ELKSink {
+  public:
+    explicit ELKUdpSink(const std::string& address);
+
+  public:
+    virtual bool Initialize() override;
+    virtual void Close() override;
+    virtual bool Send(const ELKUploadRequest& req, JsonWriter& writer) override;
+
+  private:
+    bool connect_socket();
+
+  private:
+    std::string address_;
+    int         fd_;
+    std::string buf_;
+};
+
+// 通过Unix域流式套接字写入NDJSON，连接断开后下次发送时重连
+class ELKUnixSink : public ELKSink {
+  public:
+    explicit ELKUnixSink(const std::string& path);
+
+  public:
+    virtual bool Initialize() override;
+    virtual void Close() override;
+    virtual bool Send(const ELKUploadRequest& req, JsonWriter& writer) override;
+
+  private:
+    bool connect_socket();
+
+  private:
+    std::string path_;
+    int         fd_;
+    std::string buf_;
+    // 上次发送超时时连接上留下了半行，下次发送前先补上换行
+    bool partial_line_;
+};
+#endif
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
@@ -0,0 +1,338 @@
+#include <common/log.h>
+#include <elk/spool.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/file.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#define SPOOL_MAGIC 0x50534b53  // "PSKS"
+#define SPOOL_VERSION 1
+#define SPOOL_HEADER_SIZE 64
+#define SPOOL_RECORD_HEADER_SIZE 8
+
+namespace edu {
+
+ELKSpool::ELKSpool()
+{
+    header_   = nullptr;
+    data_     = nullptr;
+    capacity_ = 0;
+    map_size_ = 0;
+#ifdef _WIN32
+    file_    = INVALID_HANDLE_VALUE;
+    mapping_ = nullptr;
+#else
+    fd_ = -1;
+#endif
+
+    bytes_   = 0;
+    dropped_ = 0;
+}
+
+ELKSpool::~ELKSpool()
+{
+    Close();
+}
+
+bool ELKSpool::Open(const std::string& path, uint64_t capacity)
+{
+    static_assert(sizeof(Header) <= SPOOL_HEADER_SIZE, "header too large");
+
+    if (header_) {
+        return true;
+    }
+
+    map_size_ = static_cast<size_t>(SPOOL_HEADER_SIZE + capacity);
+    void* addr = nullptr;
+
+    // 同一目录下的多个进程不能共用暂存文件，打开时独占，
+    // 已被其他进程占用时不使用暂存文件
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        DWORD err = GetLastError();
+        if (err == ERROR_SHARING_VIOLATION) {
+            log_w("spool file {} is used by another process", path);
+        }
+        else {
+            log_e("open spool file {} failed. err={}", path, err);
+        }
+        return false;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE,
+                                  static_cast<DWORD>(map_size_ >> 32),
+                                  static_cast<DWORD>(map_size_), nullptr);
+    if (mapping_) {
+        addr = MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, map_size_);
+    }
+    if (!addr) {
+        log_e("map spool file {} failed. err={}", path, GetLastError());
+        Close();
+        return false;
+    }
+#else
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        log_e("open spool file {} failed. errno={}", path, errno);
+        return false;
+    }
+
+    // 加锁之后才能检查和调整文件大小，否则会破坏其他进程正在使用的文件
+    if (flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+        if (errno == EWOULDBLOCK) {
+            log_w("spool file {} is used by another process", path);
+        }
+        else {
+            log_e("lock spool file {} failed. errno={}", path, errno);
+        }
+        Close();
+        return false;
+    }
+
+    // 文件大小不一致说明容量配置变化，原有记录无法恢复
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) != map_size_) {
+        if (ftruncate(fd_, 0) != 0 ||
+            ftruncate(fd_, static_cast<off_t>(map_size_)) != 0) {
+            log_e("resize spool file {} failed. errno={}", path, errno);
+            Close();
+            return false;
+        }
+    }
+
+    addr = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+        log_e("mmap spool file {} failed. errno={}", path, errno);
+        addr = nullptr;
+        Close();
+        return false;
+    }
+#endif
+
+    header_   = static_cast<Header*>(addr);
+    data_     = static_cast<uint8_t*>(addr) + SPOOL_HEADER_SIZE;
+    capacity_ = capacity;
+
+    recover();
+    log_i("spool file {} opened. records bytes={}", path, Bytes());
+
+    return true;
+}
+
+void ELKSpool::Close()
+{
+    if (header_) {
+        Flush();
+    }
+
+#ifdef _WIN32
+    if (header_) {
+        UnmapViewOfFile(header_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (header_) {
+        munmap(header_, map_size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+#endif
+
+    header_   = nullptr;
+    data_     = nullptr;
+    capacity_ = 0;
+    map_size_ = 0;
+}
+
+bool ELKSpool::IsOpen()
+{
+    return header_ != nullptr;
+}
+
+bool ELKSpool::Empty()
+{
+    return !header_ || header_->head == header_->tail;
+}
+
+void ELKSpool::Append(const std::string& record)
+{
+    if (!header_) {
+        return;
+    }
+
+    uint64_t need = SPOOL_RECORD_HEADER_SIZE + record.size();
+    if (need > capacity_) {
+        dropped_++;
+        return;
+    }
+
+    // 先丢弃最早的记录腾出空间，并在写入新数据之前更新读位置
+    uint64_t head = header_->head;
+    while (header_->tail - head + need > capacity_) {
+        uint32_t len = 0;
+        read_bytes(head, &len, sizeof(len));
+        head += SPOOL_RECORD_HEADER_SIZE + len;
+        dropped_++;
+    }
+    header_->head = head;
+
+    uint32_t len = static_cast<uint32_t>(record.size());
+    uint32_t crc = static_cast<uint32_t>(
+        crc32(0, reinterpret_cast<const Bytef*>(record.data()),
+              static_cast<uInt>(record.size())));
+
+    uint64_t tail = header_->tail;
+    write_bytes(tail, &len, sizeof(len));
+    write_bytes(tail + sizeof(len), &crc, sizeof(crc));
+    write_bytes(tail + SPOOL_RECORD_HEADER_SIZE, record.data(), record.size());
+    header_->tail = tail + need;
+
+    update_bytes();
+}
+
+uint64_t ELKSpool::Read(size_t max_bytes, std::vector<std::string>& records)
+{
+    if (!header_) {
+        return 0;
+    }
+
+    uint64_t pos   = header_->head;
+    size_t   total = 0;
+    while (pos < header_->tail) {
+        uint32_t len = 0;
+        read_bytes(pos, &len, sizeof(len));
+        if (!records.empty() && total + len > max_bytes) {
+            break;
+        }
+
+        std::string record(len, '\0');
+        read_bytes(pos + SPOOL_RECORD_HEADER_SIZE, &record[0], len);
+        records.push_back(record);
+
+        total += len;
+        pos += SPOOL_RECORD_HEADER_SIZE + len;
+    }
+
+    return pos;
+}
+
+void ELKSpool::Commit(uint64_t end)
+{
+    if (!header_ || end <= header_->head || end > header_->tail) {
+        return;
+    }
+
+    header_->head = end;
+    update_bytes();
+}
+
+void ELKSpool::Flush()
+{
+    if (!header_) {
+        return;
+    }
+
+#ifdef _WIN32
+    FlushViewOfFile(header_, 0);
+#else
+    msync(header_, map_size_, MS_ASYNC);
+#endif
+}
+
+uint64_t ELKSpool::Bytes()
+{
+    return bytes_;
+}
+
+uint64_t ELKSpool::Dropped()
+{
+    return dropped_;
+}
+
+void ELKSpool::read_bytes(uint64_t offset, void* dst, size_t len)
+{
+    size_t pos   = static_cast<size_t>(offset % capacity_);
+    size_t first = std::min<size_t>(len, capacity_ - pos);
+    memcpy(dst, data_ + pos, first);
+    memcpy(static_cast<uint8_t*>(dst) + first, data_, len - first);
+}
+
+void ELKSpool::write_bytes(uint64_t offset, const void* src, size_t len)
+{
+    size_t pos   = static_cast<size_t>(offset % capacity_);
+    size_t first = std::min<size_t>(len, capacity_ - pos);
+    memcpy(data_ + pos, src, first);
+    memcpy(data_, static_cast<const uint8_t*>(src) + first, len - first);
+}
+
+void ELKSpool::recover()
+{
+    if (header_->magic != SPOOL_MAGIC || header_->version != SPOOL_VERSION ||
+        header_->capacity != capacity_ || header_->head > header_->tail ||
+        header_->tail - header_->head > capacity_) {
+        header_->magic    = SPOOL_MAGIC;
+        header_->version  = SPOOL_VERSION;
+        header_->capacity = capacity_;
+        header_->head     = 0;
+        header_->tail     = 0;
+        update_bytes();
+        return;
+    }
+
+    // 写位置之前的记录可能只写了一部分，校验失败的记录及其之后的都丢弃
+    uint64_t    pos = header_->head;
+    std::string record;
+    while (pos + SPOOL_RECORD_HEADER_SIZE <= header_->tail) {
+        uint32_t len = 0;
+        uint32_t crc = 0;
+        read_bytes(pos, &len, sizeof(len));
+        read_bytes(pos + sizeof(len), &crc, sizeof(crc));
+        if (pos + SPOOL_RECORD_HEADER_SIZE + len > header_->tail) {
+            break;
+        }
+
+        record.resize(len);
+        read_bytes(pos + SPOOL_RECORD_HEADER_SIZE, &record[0], len);
+        if (crc32(0, reinterpret_cast<const Bytef*>(record.data()),
+                  static_cast<uInt>(len)) != crc) {
+            break;
+        }
+        pos += SPOOL_RECORD_HEADER_SIZE + len;
+    }
+
+    if (pos != header_->tail) {
+        log_w("spool truncated from {} to {}", header_->tail, pos);
+        header_->tail = pos;
+    }
+    update_bytes();
+}
+
+void ELKSpool::update_bytes()
+{
+    bytes_ = header_->tail - header_->head;
+}
+
+}  // namespace edu
\ No newline at end of file
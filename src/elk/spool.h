@@ -0,0 +1,73 @@
+#ifndef EDU_PUSH_SDK_SPOOL_H
+#define EDU_PUSH_SDK_SPOOL_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace edu {
+
+// 上传失败的ELK日志暂存在磁盘上的环形文件中，文件通过mmap映射，大小固定。
+// 文件头记录读写位置(只增不减的逻辑偏移)，每条记录为[长度][crc32][内容]，
+// 先写内容再更新写位置，重新打开时从读位置开始校验，丢弃不完整的尾部记录。
+// 打开时独占文件，已被其他进程打开时Open失败。
+// 只在ELK上传线程中使用，非线程安全(统计除外)
+class ELKSpool {
+  public:
+    ELKSpool();
+    ~ELKSpool();
+
+  public:
+    // 打开或创建文件，已有文件容量一致时恢复其中尚未上传的记录
+    bool Open(const std::string& path, uint64_t capacity);
+    void Close();
+    bool IsOpen();
+    bool Empty();
+
+    // 追加一条记录，空间不足时丢弃最早的记录
+    void Append(const std::string& record);
+    // 从最早的记录开始读取，总长度不超过max_bytes(至少读一条)，返回读取结束的位置
+    uint64_t Read(size_t max_bytes, std::vector<std::string>& records);
+    // 上传成功后删除end之前的记录
+    void Commit(uint64_t end);
+    // 把修改异步写回磁盘
+    void Flush();
+
+    uint64_t Bytes();
+    uint64_t Dropped();
+
+  private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t capacity;
+        uint64_t head;
+        uint64_t tail;
+    };
+
+    void read_bytes(uint64_t offset, void* dst, size_t len);
+    void write_bytes(uint64_t offset, const void* src, size_t len);
+    void recover();
+    void update_bytes();
+
+  private:
+    Header*  header_;
+    uint8_t* data_;
+    uint64_t capacity_;
+    size_t   map_size_;
+#ifdef _WIN32
+    void* file_;
+    void* mapping_;
+#else
+    int fd_;
+#endif
+
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> dropped_;
+};
+
+}  // namespace edu
+
+#endif
\ No newline at end of file
@@ -3,14 +3,49 @@
 
 #include <common/config.h>
 #include <common/utils.h>
+#include <elk/json_writer.h>
 #include <repo_version.h>
 
-#include <json/json.h>
-
+#include <cstring>
 #include <deque>
+#include <vector>
 
 namespace edu {
 
+// 不拥有内存的字符串参数，const char*和std::string都可以隐式转换，不分配内存
+struct ELKText
+{
+    ELKText(const char* str)
+    {
+        data = str;
+        size = str ? strlen(str) : 0;
+    }
+
+    ELKText(const std::string& str)
+    {
+        data = str.data();
+        size = str.size();
+    }
+
+    const char* data;
+    size_t      size;
+};
+
+// 调用线程写入缓冲的定长日志记录，字符串超长时截断并设置truncated，
+// 上传时带上truncated字段
+struct ELKRecord
+{
+    char     system_time[24];
+    char     action[32];
+    char     group_info[96];
+    char     msg[192];
+    uint64_t appid;
+    uint64_t suid;
+    uint32_t uid;
+    int32_t  code;
+    bool     truncated;
+};
+
 class ELKUploadItem {
   public:
     ELKUploadItem(const std::string system_time,
@@ -34,38 +69,92 @@ class ELKUploadItem {
         this->action     = action;
         this->code       = code;
         this->msg        = msg;
+        this->count      = 1;
+        this->truncated  = false;
+    }
+
+    explicit ELKUploadItem(const ELKRecord& r)
+        : ELKUploadItem(r.system_time, r.appid, r.uid, r.suid, r.group_info,
+                        r.action, r.code, r.msg)
+    {
+        truncated = r.truncated;
+    }
+
+  public:
+    // 合并一条相同的日志
+    void Merge(const std::string& time)
+    {
+        count++;
+        last_time = time;
     }
 
   public:
-    operator Json::Value() const
+    void Write(JsonWriter& w) const
     {
-        Json::Value root;
-        root["sdk_version"]  = PUSH_SDK_VERSION;
-        root["repo_version"] = REPO_VERSION;
-        root["system_time"]  = system_time;
-        root["appid"]        = static_cast<Json::UInt64>(appid);
-        // root["gid"]          = static_cast<Json::UInt64>(gid);
-        // root["gtype"]        = static_cast<Json::UInt64>(gtype);
-        root["group_info"] = group_info;
-        root["uid"]        = uid;
-        root["suid"]       = static_cast<Json::UInt64>(suid);
-        root["action"]     = action;
-        root["code"]       = code;
-        root["msg"]        = msg;
-        root["platform"]   = Utils::GetPlatformName();
-
-        return root;
+        w.BeginObject();
+        w.Raw(common_fields());
+        w.Key("system_time");
+        w.String(system_time);
+        w.Key("appid");
+        w.Uint(appid);
+        // w.Key("gid");
+        // w.Uint(gid);
+        // w.Key("gtype");
+        // w.Uint(gtype);
+        w.Key("group_info");
+        w.String(group_info);
+        w.Key("uid");
+        w.Uint(uid);
+        w.Key("suid");
+        w.Uint(suid);
+        w.Key("action");
+        w.String(action);
+        w.Key("code");
+        w.Int(code);
+        w.Key("msg");
+        w.String(msg);
+        w.Key("count");
+        w.Uint(count);
+        if (truncated) {
+            w.Key("truncated");
+            w.Bool(true);
+        }
+        if (count > 1) {
+            w.Key("last_time");
+            w.String(last_time);
+        }
+        w.EndObject();
     }
 
-    operator std::string() 
+    operator std::string() const
     {
-        Json::Value      root = *this;
-        std::string      str;
-        Json::FastWriter w;
+        JsonWriter w;
+        Write(w);
+        return w.Data();
+    }
 
-        str = w.write(root);
+    // 序列化后大小的估计值，用于按字节数触发上传
+    size_t Size() const
+    {
+        return common_fields().size() + system_time.size() +
+               group_info.size() + action.size() + msg.size() + 160;
+    }
 
-        return str.substr(0, str.size() - 1);
+  private:
+    // 每条日志都相同的字段，每个进程只渲染一次
+    static const std::string& common_fields()
+    {
+        static const std::string fields = []() {
+            JsonWriter w;
+            w.Key("sdk_version");
+            w.String(PUSH_SDK_VERSION);
+            w.Key("repo_version");
+            w.String(REPO_VERSION);
+            w.Key("platform");
+            w.String(Utils::GetPlatformName());
+            return w.Data();
+        }();
+        return fields;
     }
 
   public:
@@ -81,32 +170,51 @@ class ELKUploadItem {
     int         code;
     std::string msg;
     std::string platform;
+    // 合并的日志条数和最后一条的时间，system_time为第一条的时间
+    uint32_t    count;
+    std::string last_time;
+    // 写入缓冲时有字段被截断
+    bool truncated;
 };
 
 class ELKUploadRequest {
   public:
-    operator std::string()
+    void Write(JsonWriter& w) const
     {
-        Json::Value root;
-        root["project"]  = Config::Instance()->elk_project_name;
-        root["region"]   = Config::Instance()->elk_region;
-        root["logStore"] = Config::Instance()->elk_log_store;
-        root["encode"]   = Config::Instance()->elk_encode;
-        root["source"]   = Config::Instance()->elk_source;
-        for (std::shared_ptr<ELKUploadItem>& item : contents) {
-            root["content"].append(*item);
+        w.BeginObject();
+        w.Key("project");
+        w.String(Config::Instance()->elk_project_name);
+        w.Key("region");
+        w.String(Config::Instance()->elk_region);
+        w.Key("logStore");
+        w.String(Config::Instance()->elk_log_store);
+        w.Key("encode");
+        w.Int(Config::Instance()->elk_encode);
+        w.Key("source");
+        w.String(Config::Instance()->elk_source);
+        w.Key("content");
+        w.BeginArray();
+        for (const std::shared_ptr<ELKUploadItem>& item : contents) {
+            item->Write(w);
         }
+        for (const std::string& item : raw_contents) {
+            w.Raw(item);
+        }
+        w.EndArray();
+        w.EndObject();
+    }
 
-        std::string      str;
-        Json::FastWriter w;
-
-        str = w.write(root);
-
-        return str.substr(0, str.size() - 1);
+    operator std::string() const
+    {
+        JsonWriter w;
+        Write(w);
+        return w.Data();
     }
 
   public:
     std::deque<std::shared_ptr<ELKUploadItem>> contents;
+    // 已经序列化好的日志，如从磁盘暂存文件中读出的日志
+    std::vector<std::string> raw_contents;
 };
 
 }  // namespace edu
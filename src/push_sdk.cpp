@@ -1,5 +1,7 @@
+#include <common/config.h>
 #include <common/log.h>
 #include <core/core.h>
+#include <core/session_manager.h>
 #include <push_sdk.h>
 
 #include <mutex>
@@ -10,6 +12,13 @@ static std::mutex    _mux;
 static volatile bool _initialized(false);
 static volatile bool _log_initialized(false);
 
+// PS_SESSION 指向的对象，mux的作用与_mux相同
+struct PushSDKSession
+{
+    std::shared_ptr<edu::PushSDK> sdk;
+    std::mutex                    mux;
+};
+
 PushSDKRetCode PushSDKInitialize(uint32_t       uid,
                                  uint64_t       appid,
                                  uint64_t       appkey,
@@ -30,7 +39,7 @@ PushSDKRetCode PushSDKInitialize(uint32_t       uid,
             //日志库初始化失败, 不打日志
             return ret;
         }
-        edu::ELKAsyncUploader::Instance()->Initialize();
+        edu::ELKAsyncUploader::Instance()->Initialize(log_dir);
         _log_initialized = true;
     }
 
@@ -40,12 +49,22 @@ PushSDKRetCode PushSDKInitialize(uint32_t       uid,
         return ret;
     }
 
+    if ((ret = static_cast<PushSDKRetCode>(
+             edu::SessionManager::Instance()->Initialize())) !=
+        PS_RET_SUCCESS) {
+        log_e("session manager initailize failed. ret={}", ret);
+        return ret;
+    }
+
     if ((ret = static_cast<PushSDKRetCode>(edu::PushSDK::Instance()->Initialize(
              uid, appid, appkey, cb_func, cb_arg))) != PS_RET_SUCCESS) {
         log_e("push_sdk initailize failed. ret={}", ret);
+        edu::SessionManager::Instance()->Destroy();
         return ret;
     }
 
+    edu::Config::Instance()->SetRunning(true);
+
     log_i("push_sdk initialize successfully. uid={}, appid={}, appkey={}", uid,
           appid, appkey);
 
@@ -53,20 +72,36 @@ PushSDKRetCode PushSDKInitialize(uint32_t       uid,
     return ret;
 }
 
-void PushSDKDestroy()
+PushSDKRetCode PushSDKDestroy()
 {
     if (!_initialized) {
-        return;
+        return PS_RET_SUCCESS;
+    }
+
+    // 会等待SDK内部线程退出，不能在回调中调用
+    if (edu::SessionManager::Instance()->IsInnerThread()) {
+        log_e("push_sdk destroy in sdk inner thread is not allowed");
+        return PS_RET_IN_SDK_THREAD;
     }
 
     edu::PushSDK::Instance()->Destroy();
+    edu::SessionManager::Instance()->Destroy();
+    edu::Config::Instance()->SetRunning(false);
 
+    edu::ELKAsyncUploader::Instance()->Flush(
+        edu::Config::Instance()->elk_upload_flush_timeout_ms);
     flush_logger();
 
     _initialized = false;
+    return PS_RET_SUCCESS;
 }
 
 PushSDKRetCode PushSDKLogin(PushSDKUserInfo* user)
+{
+    return PushSDKLoginWithTimeout(user, 0);
+}
+
+PushSDKRetCode PushSDKLoginWithTimeout(PushSDKUserInfo* user, int timeout_ms)
 {
     PushSDKRetCode               ret = PS_RET_SUCCESS;
     std::unique_lock<std::mutex> lock(_mux);
@@ -83,8 +118,10 @@ PushSDKRetCode PushSDKLogin(PushSDKUserInfo* user)
     }
 
     if ((ret = static_cast<PushSDKRetCode>(
-             edu::PushSDK::Instance()->Login(*user))) != PS_RET_SUCCESS) {
-        if (ret != PS_RET_CALL_TIMEOUT) {
+             edu::PushSDK::Instance()->Login(
+                 *user, true, nullptr, nullptr, timeout_ms))) !=
+        PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
             log_e("login failed. ret={}", ret);
         }
         return ret;
@@ -94,6 +131,11 @@ PushSDKRetCode PushSDKLogin(PushSDKUserInfo* user)
 }
 
 PushSDKRetCode PushSDKLogout()
+{
+    return PushSDKLogoutWithTimeout(0);
+}
+
+PushSDKRetCode PushSDKLogoutWithTimeout(int timeout_ms)
 {
     PushSDKRetCode               ret = PS_RET_SUCCESS;
     std::unique_lock<std::mutex> lock(_mux);
@@ -104,8 +146,9 @@ PushSDKRetCode PushSDKLogout()
     }
 
     if ((ret = static_cast<PushSDKRetCode>(
-             edu::PushSDK::Instance()->Logout())) != PS_RET_SUCCESS) {
-        if (ret != PS_RET_CALL_TIMEOUT) {
+             edu::PushSDK::Instance()->Logout(true, nullptr, nullptr,
+                                              timeout_ms))) != PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
             log_e("logout failed. ret={}", ret);
         }
         return ret;
@@ -115,6 +158,12 @@ PushSDKRetCode PushSDKLogout()
 }
 
 PushSDKRetCode PushSDKJoinGroup(PushSDKGroupInfo* group)
+{
+    return PushSDKJoinGroupWithTimeout(group, 0);
+}
+
+PushSDKRetCode PushSDKJoinGroupWithTimeout(PushSDKGroupInfo* group,
+                                           int               timeout_ms)
 {
     PushSDKRetCode               ret = PS_RET_SUCCESS;
     std::unique_lock<std::mutex> lock(_mux);
@@ -125,8 +174,10 @@ PushSDKRetCode PushSDKJoinGroup(PushSDKGroupInfo* group)
     }
 
     if ((ret = static_cast<PushSDKRetCode>(
-             edu::PushSDK::Instance()->JoinGroup(*group))) != PS_RET_SUCCESS) {
-        if (ret != PS_RET_CALL_TIMEOUT) {
+             edu::PushSDK::Instance()->JoinGroup(
+                 *group, true, nullptr, nullptr, timeout_ms))) !=
+        PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
             log_e("join group failed. ret={}", ret);
         }
         return ret;
@@ -136,6 +187,12 @@ PushSDKRetCode PushSDKJoinGroup(PushSDKGroupInfo* group)
 }
 
 PushSDKRetCode PushSDKLeaveGroup(PushSDKGroupInfo* group)
+{
+    return PushSDKLeaveGroupWithTimeout(group, 0);
+}
+
+PushSDKRetCode PushSDKLeaveGroupWithTimeout(PushSDKGroupInfo* group,
+                                            int               timeout_ms)
 {
     PushSDKRetCode               ret = PS_RET_SUCCESS;
     std::unique_lock<std::mutex> lock(_mux);
@@ -146,8 +203,10 @@ PushSDKRetCode PushSDKLeaveGroup(PushSDKGroupInfo* group)
     }
 
     if ((ret = static_cast<PushSDKRetCode>(
-             edu::PushSDK::Instance()->LeaveGroup(*group))) != PS_RET_SUCCESS) {
-        if (ret != PS_RET_CALL_TIMEOUT) {
+             edu::PushSDK::Instance()->LeaveGroup(
+                 *group, true, nullptr, nullptr, timeout_ms))) !=
+        PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
             log_e("leave group failed. ret={}", ret);
         }
         return ret;
@@ -156,6 +215,31 @@ PushSDKRetCode PushSDKLeaveGroup(PushSDKGroupInfo* group)
     return ret;
 }
 
+PushSDKRetCode PushSDKCancelCall(PushSDKCBType type)
+{
+    // 不持有_mux, 否则无法打断正在进行的同步调用
+    if (!_initialized) {
+        return PS_RET_SDK_UNINIT;
+    }
+
+    edu::PushSDK::Instance()->CancelCall(type);
+
+    return PS_RET_SUCCESS;
+}
+
+PushSDKRetCode PushSDKCancelGroupCall(PushSDKCBType     type,
+                                      PushSDKGroupInfo* group)
+{
+    // 不持有_mux, 否则无法打断正在进行的同步调用
+    if (!_initialized) {
+        return PS_RET_SDK_UNINIT;
+    }
+
+    edu::PushSDK::Instance()->CancelCall(type, group);
+
+    return PS_RET_SUCCESS;
+}
+
 void PushSDKGetError(char** desc, int* code)
 {
     std::string s;
@@ -171,6 +255,231 @@ void PushSDKGetError(char** desc, int* code)
     *code = c;
 }
 
+PushSDKRetCode PushSDKSetConfig(const char* key, const char* value)
+{
+    if (!key || !value) {
+        return PS_RET_CONFIG_INVALID;
+    }
+
+    return static_cast<PushSDKRetCode>(
+        edu::Config::Instance()->Set(key, value));
+}
+
+PushSDKRetCode PushSDKLoadConfig(const char* path)
+{
+    if (!path) {
+        return PS_RET_CONFIG_INVALID;
+    }
+
+    return static_cast<PushSDKRetCode>(
+        edu::Config::Instance()->LoadFile(path));
+}
+
+PushSDKRetCode PushSDKGetStats(PushSDKStats* stats)
+{
+    if (!_initialized) {
+        return PS_RET_SDK_UNINIT;
+    }
+
+    if (!stats) {
+        return PS_RET_SUCCESS;
+    }
+
+    memset(stats, 0, sizeof(PushSDKStats));
+    edu::PushSDK::Instance()->GetStats(*stats);
+    edu::SessionManager::Instance()->GetStats(*stats);
+    edu::ELKAsyncUploader::Instance()->GetStats(*stats);
+
+    return PS_RET_SUCCESS;
+}
+
+PushSDKRetCode PushSDKSessionCreate(uint32_t       uid,
+                                    PushSDKEventCB cb_func,
+                                    void*          cb_arg,
+                                    PS_SESSION*    session)
+{
+    PushSDKRetCode ret = PS_RET_SUCCESS;
+
+    if (!_initialized) {
+        ret = PS_RET_SDK_UNINIT;
+        return ret;
+    }
+
+    if (!cb_func || !session) {
+        ret = PS_RET_CB_IS_NULL;
+        log_e("call back function or session is null");
+        return ret;
+    }
+
+    uint64_t appid;
+    uint64_t appkey;
+    edu::PushSDK::Instance()->GetAppInfo(appid, appkey);
+
+    PushSDKSession* s = new PushSDKSession;
+    s->sdk            = edu::PushSDK::CreateSession();
+    if ((ret = static_cast<PushSDKRetCode>(s->sdk->Initialize(
+             uid, appid, appkey, cb_func, cb_arg))) != PS_RET_SUCCESS) {
+        log_e("session initailize failed. uid={}, ret={}", uid, ret);
+        delete s;
+        return ret;
+    }
+
+    log_i("session create successfully. uid={}", uid);
+
+    *session = s;
+    return ret;
+}
+
+PushSDKRetCode PushSDKSessionDestroy(PS_SESSION session)
+{
+    PushSDKRetCode ret = PS_RET_SUCCESS;
+
+    if (!session) {
+        return ret;
+    }
+
+    PushSDKSession* s = reinterpret_cast<PushSDKSession*>(session);
+    if ((ret = static_cast<PushSDKRetCode>(s->sdk->Destroy())) !=
+        PS_RET_SUCCESS) {
+        return ret;
+    }
+    delete s;
+
+    return ret;
+}
+
+PushSDKRetCode
+PushSDKSessionLogin(PS_SESSION session, PushSDKUserInfo* user, int timeout_ms)
+{
+    PushSDKRetCode ret = PS_RET_SUCCESS;
+
+    if (!_initialized || !session) {
+        ret = PS_RET_SDK_UNINIT;
+        return ret;
+    }
+
+    if (!user) {
+        ret = PS_RET_USER_INFO_IS_NULL;
+        log_e("login with user info(null) is not allow. ret={}", ret);
+        return ret;
+    }
+
+    PushSDKSession*              s = reinterpret_cast<PushSDKSession*>(session);
+    std::unique_lock<std::mutex> lock(s->mux);
+
+    if ((ret = static_cast<PushSDKRetCode>(
+             s->sdk->Login(*user, true, nullptr, nullptr, timeout_ms))) !=
+        PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
+            log_e("session login failed. ret={}", ret);
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+PushSDKRetCode PushSDKSessionLogout(PS_SESSION session, int timeout_ms)
+{
+    PushSDKRetCode ret = PS_RET_SUCCESS;
+
+    if (!_initialized || !session) {
+        ret = PS_RET_SDK_UNINIT;
+        return ret;
+    }
+
+    PushSDKSession*              s = reinterpret_cast<PushSDKSession*>(session);
+    std::unique_lock<std::mutex> lock(s->mux);
+
+    if ((ret = static_cast<PushSDKRetCode>(
+             s->sdk->Logout(true, nullptr, nullptr, timeout_ms))) !=
+        PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
+            log_e("session logout failed. ret={}", ret);
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+PushSDKRetCode PushSDKSessionJoinGroup(PS_SESSION        session,
+                                       PushSDKGroupInfo* group,
+                                       int               timeout_ms)
+{
+    PushSDKRetCode ret = PS_RET_SUCCESS;
+
+    if (!_initialized || !session) {
+        ret = PS_RET_SDK_UNINIT;
+        return ret;
+    }
+
+    PushSDKSession*              s = reinterpret_cast<PushSDKSession*>(session);
+    std::unique_lock<std::mutex> lock(s->mux);
+
+    if ((ret = static_cast<PushSDKRetCode>(s->sdk->JoinGroup(
+             *group, true, nullptr, nullptr, timeout_ms))) != PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
+            log_e("session join group failed. ret={}", ret);
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+PushSDKRetCode PushSDKSessionLeaveGroup(PS_SESSION        session,
+                                        PushSDKGroupInfo* group,
+                                        int               timeout_ms)
+{
+    PushSDKRetCode ret = PS_RET_SUCCESS;
+
+    if (!_initialized || !session) {
+        ret = PS_RET_SDK_UNINIT;
+        return ret;
+    }
+
+    PushSDKSession*              s = reinterpret_cast<PushSDKSession*>(session);
+    std::unique_lock<std::mutex> lock(s->mux);
+
+    if ((ret = static_cast<PushSDKRetCode>(s->sdk->LeaveGroup(
+             *group, true, nullptr, nullptr, timeout_ms))) != PS_RET_SUCCESS) {
+        if (ret != PS_RET_CALL_TIMEOUT && ret != PS_RET_CALL_CANCELED) {
+            log_e("session leave group failed. ret={}", ret);
+        }
+        return ret;
+    }
+
+    return ret;
+}
+
+void PushSDKSessionGetError(PS_SESSION session, char** desc, int* code)
+{
+    std::string s;
+    int         c = 0;
+
+    if (session) {
+        PushSDKSession* ps = reinterpret_cast<PushSDKSession*>(session);
+        std::unique_lock<std::mutex> lock(ps->mux);
+        ps->sdk->GetLastError(s, c);
+    }
+
+    *desc = (char*)malloc(s.length() + 1);
+    memcpy(*desc, s.c_str(), s.length());
+    (*desc)[s.length()] = '\0';
+
+    *code = c;
+}
+
+PS_HANDLER PushSDKSessionCreateHandler(PS_SESSION session)
+{
+    if (!session) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<PushSDKSession*>(session)->sdk->CreateHandler();
+}
+
 PS_HANDLER PushSDKCreateHandler()
 {
     return edu::PushSDK::Instance()->CreateHandler();
@@ -182,8 +491,7 @@ void PushSDKDestroyHandler(PS_HANDLER handler)
         return;
     }
 
-    edu::PushSDK::Instance()->DestroyHandler(
-        reinterpret_cast<edu::Handler*>(handler));
+    edu::PushSDK::DestroyHandler(reinterpret_cast<edu::Handler*>(handler));
 }
 
 void PushSDKSetConnStateCB(PS_HANDLER handler, PushSDKConnStateCB state_cb)
@@ -192,7 +500,7 @@ void PushSDKSetConnStateCB(PS_HANDLER handler, PushSDKConnStateCB state_cb)
         return;
     }
 
-    edu::PushSDK::Instance()->AddConnStateCBToHandler(
+    edu::PushSDK::AddConnStateCBToHandler(
         reinterpret_cast<edu::Handler*>(handler), state_cb);
 }
 
@@ -202,7 +510,7 @@ void PushSDKSetUserMsgCB(PS_HANDLER handler, PushSDKUserMsgCB msg_cb)
         return;
     }
 
-    edu::PushSDK::Instance()->AddUserMsgCBToHandler(
+    edu::PushSDK::AddUserMsgCBToHandler(
         reinterpret_cast<edu::Handler*>(handler), msg_cb);
 }
 
@@ -211,6 +519,6 @@ void PushSDKSetGroupMsgCB(PS_HANDLER handler, PushSDKGroupMsgCB msg_cb)
     if (!handler || !msg_cb) {
         return;
     }
-    edu::PushSDK::Instance()->AddGroupMsgCBToHandler(
+    edu::PushSDK::AddGroupMsgCBToHandler(
         reinterpret_cast<edu::Handler*>(handler), msg_cb);
 }
\ No newline at end of file